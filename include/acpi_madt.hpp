@@ -62,6 +62,7 @@ public:
         LAPIC = 0,
         IOAPIC = 1,
         INTR = 2,
+        LX2APIC = 9,
     };
 };
 
@@ -76,6 +77,18 @@ public:
     uint32 flags;
 };
 
+/*
+ * Processor Local x2APIC (5.2.11.13)
+ */
+class Acpi_lx2apic : public Acpi_apic
+{
+public:
+    uint16 reserved;
+    uint32 x2apic_id;
+    uint32 flags;
+    uint32 acpi_id;
+};
+
 /*
  * I/O APIC (5.2.11.6)
  */
@@ -108,6 +121,8 @@ class Acpi_table_madt : public Acpi_table
 private:
     static void parse_lapic(Acpi_apic const*);
 
+    static void parse_lx2apic(Acpi_apic const*);
+
     static void parse_ioapic(Acpi_apic const*);
 
     void parse_entry(Acpi_apic::Type, void (*)(Acpi_apic const*)) const;
@@ -120,6 +135,9 @@ public:
     static inline bool sci_overridden = false;
     static inline bool pic_present = false;
 
+    // Set if an enabled CPU has an APIC ID that does not fit into 8 bits.
+    static inline bool wide_apic_ids = false;
+
     void parse() const;
 
     static void parse_intr(Acpi_apic const*);
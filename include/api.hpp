@@ -38,4 +38,6 @@ enum class hypercall_id
     HC_ASSIGN_PCI = 13,
     HC_ASSIGN_GSI = 14,
     HC_MACHINE_CTRL = 15,
+    HC_MULTICALL = 16,
+    HC_DIRTY_LOG = 17,
 };
@@ -0,0 +1,74 @@
+/*
+ * Bit Range Updates
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include "atomic.hpp"
+#include "types.hpp"
+
+// Set or clear count bits starting at bit first in an array of words.
+//
+// Words that are only partially covered by the range may hold bits of other
+// ranges that are updated concurrently, so they are changed with atomic
+// operations. Words in the middle of the range belong to this range alone
+// and are written with plain stores.
+template <typename T> void update_bit_range(T* words, size_t first, size_t count, bool value)
+{
+    constexpr size_t BITS_PER_WORD{sizeof(T) * 8};
+
+    // Returns a mask with bits [from, to) set, where 0 <= from < to <= BITS_PER_WORD.
+    auto const mask = [](size_t from, size_t to) {
+        T const upper{to == BITS_PER_WORD ? static_cast<T>(~T{0}) : static_cast<T>((T{1} << to) - 1)};
+        return static_cast<T>(upper & ~static_cast<T>((T{1} << from) - 1));
+    };
+
+    auto const update_partial = [value](T& word, T m) {
+        if (value)
+            Atomic::set_mask(word, m);
+        else
+            Atomic::clr_mask(word, m);
+    };
+
+    if (count == 0)
+        return;
+
+    size_t const last{first + count - 1};
+    size_t const first_word{first / BITS_PER_WORD};
+    size_t const last_word{last / BITS_PER_WORD};
+
+    if (first_word == last_word) {
+        update_partial(words[first_word], mask(first % BITS_PER_WORD, last % BITS_PER_WORD + 1));
+        return;
+    }
+
+    size_t full_begin{first_word};
+    size_t full_end{last_word + 1};
+
+    if (first % BITS_PER_WORD) {
+        update_partial(words[first_word], mask(first % BITS_PER_WORD, BITS_PER_WORD));
+        full_begin++;
+    }
+
+    if (last % BITS_PER_WORD != BITS_PER_WORD - 1) {
+        update_partial(words[last_word], mask(0, last % BITS_PER_WORD + 1));
+        full_end--;
+    }
+
+    T const fill{value ? static_cast<T>(~T{0}) : T{0}};
+
+    for (size_t i{full_begin}; i < full_end; i++) {
+        words[i] = fill;
+    }
+}
@@ -20,6 +20,8 @@
 
 #pragma once
 
+#include "assert.hpp"
+#include "cpulocal.hpp"
 #include "extern.hpp"
 #include "memory.hpp"
 #include "spinlock.hpp"
@@ -42,6 +44,20 @@ private:
         };
     };
 
+    // Adapter that lets the per-CPU page caches refill from and drain to the
+    // global block lists of a specific order.
+    class Order_backend
+    {
+        Buddy& buddy;
+        unsigned short const ord;
+
+    public:
+        size_t alloc_bulk(void** pages, size_t n);
+        void free_bulk(void* const* pages, size_t n);
+
+        Order_backend(Buddy& b, unsigned short o) : buddy(b), ord(o) {}
+    };
+
     Spinlock lock;
     signed long max_idx;
     signed long min_idx;
@@ -50,6 +66,19 @@ private:
     Block* index;
     Block* head;
 
+    // The number of pages in the global block lists.
+    size_t free_pages{0};
+
+    // Incremented by every request to drain the page caches of all CPUs.
+    unsigned drain_request{0};
+
+    // How long we wait for other CPUs to drain their page caches.
+    static constexpr unsigned DRAIN_TIMEOUT_MS{10};
+
+    // The zero page pools are not refilled when the global block lists hold
+    // fewer pages than this. These pages are left for actual allocations.
+    static constexpr size_t ZERO_POOL_RESERVE{NUM_CPU * NUM_ZERO_PAGES};
+
     inline signed long block_to_index(Block* b) { return b - index; }
 
     inline Block* index_to_block(signed long i) { return index + i; }
@@ -62,7 +91,47 @@ private:
 
     inline mword phys_to_virt(mword phys) { return PHYS_TO_VIRT_NORELOC(phys - PHYS_RELOCATION); }
 
+    inline Block* used_block(mword virt)
+    {
+        signed long idx = page_to_index(virt);
+
+        assert(idx >= min_idx && idx < max_idx);
+        assert(index_to_block(idx)->tag == Block::Used);
+
+        return index_to_block(idx);
+    }
+
+    CPULOCAL_ACCESSOR(buddy, page_cache);
+    CPULOCAL_ACCESSOR(buddy, zero_pool);
+    CPULOCAL_ACCESSOR(buddy, zero_pool_count);
+    CPULOCAL_REMOTE_ACCESSOR(buddy, drained);
+
+    // Allocate a block while holding the lock. Returns nullptr, if there
+    // is no free block of sufficient size.
+    void* alloc_locked(unsigned short ord);
+
+    // Free a block while holding the lock.
+    void free_locked(mword virt);
+
+    // Count an acquisition of the global lock. See COUNTER_BUDDY_GLOBAL.
+    static void count_lock();
+
+    // Return all pages in the page caches and the zero page pool of the
+    // current CPU.
+    void drain_page_cache();
+
+    // Ask all other CPUs to return the pages in their page caches and zero
+    // page pools and wait until they did.
+    //
+    // A CPU that spins on a lock we hold cannot take the IPI, so we give up
+    // waiting after DRAIN_TIMEOUT_MS.
+    void drain_remote_page_caches();
+
 public:
+    // Blocks up to this order are served from per-CPU page caches. Only
+    // refilling and draining these caches touches the global lock.
+    static constexpr unsigned short NUM_CACHED_ORDERS{2};
+
     enum Fill
     {
         NOFILL,
@@ -80,6 +149,33 @@ public:
 
     void free(mword addr);
 
+    // Handle a drain request of another CPU that ran out of memory.
+    static void drain_handler();
+
+    // Add a zeroed page to the zero page pool of the current CPU. FILL_0
+    // allocations of single pages are served from this pool.
+    //
+    // Returns true, if the pool needs more pages.
+    bool refill_zero_pool();
+
+    // Link an allocated block to another allocated block (or 0).
+    //
+    // This allows building singly-linked lists of blocks that are threaded
+    // through the allocator metadata instead of the blocks themselves. The
+    // memory of linked blocks is left untouched, which is useful for memory
+    // that may still be accessed by hardware until it can be freed.
+    void set_link(mword addr, mword next)
+    {
+        used_block(addr)->next = next ? used_block(next) : nullptr;
+    }
+
+    // Return the block linked to an allocated block via set_link().
+    mword get_link(mword addr)
+    {
+        Block* next = used_block(addr)->next;
+        return next ? index_to_page(block_to_index(next)) : 0;
+    }
+
     static inline void* phys_to_ptr(Paddr phys)
     {
         return reinterpret_cast<void*>(allocator.phys_to_virt(static_cast<mword>(phys)));
@@ -40,6 +40,7 @@ public:
     static inline bool iommu;
     static inline bool serial;
     static inline bool nodl;
+    static inline bool x2apic;
     static inline bool nopcid;
     static inline bool novga;
     static inline bool novpid;
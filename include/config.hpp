@@ -33,7 +33,7 @@
 /// numbers is backwards incompatible and requires a major version bump. The
 /// addition of a new hypercall without changing any of the existing hypercalls
 /// is backwards compatible and requires a minor version bump.
-#define CFG_VER 5004
+#define CFG_VER 5015
 
 #define NUM_CPU 64
 #define NUM_IRQ 16
@@ -42,8 +42,12 @@
 #define NUM_GSI 192
 #define NUM_LVT 6
 #define NUM_MSI 1
-#define NUM_IPI 4
+#define NUM_IPI 6
 #define NUM_PRIORITIES 128
+#define NUM_SLAB_MAGAZINES 16
+#define NUM_ZERO_PAGES 32
+#define NUM_PCIDS 32
+#define TRACE_RING_PAGES 4
 
 #define SPN_SCH 0
 #define SPN_HLP 1
@@ -27,10 +27,40 @@
 class Counter
 {
 public:
+    // Counters that can be read from userspace via machine_ctrl_read_counter.
+    enum Id
+    {
+        TLB_SHOOTDOWN = 0,       // TLB shootdown IPIs handled
+        BUDDY_GLOBAL = 1,        // Acquisitions of the global page allocator lock
+        SHOOTDOWN_COALESCED = 2, // TLB shootdowns saved by batching delegations
+        NUM_COUNTERS,
+    };
+
     CPULOCAL_ACCESSOR(counter, tlb_shootdown);
+    CPULOCAL_ACCESSOR(counter, buddy_global);
+    CPULOCAL_ACCESSOR(counter, shootdown_coalesced);
 
     static inline unsigned remote_tlb_shootdown(unsigned cpu)
     {
         return Atomic::load(Cpulocal::get_remote(cpu).counter_tlb_shootdown);
     }
+
+    // Read the counter with the given ID on the given CPU.
+    static inline uint64 remote_read(Id id, unsigned cpu)
+    {
+        Per_cpu& per_cpu{Cpulocal::get_remote(cpu)};
+
+        switch (id) {
+        case TLB_SHOOTDOWN:
+            return Atomic::load(per_cpu.counter_tlb_shootdown);
+        case BUDDY_GLOBAL:
+            return Atomic::load(per_cpu.counter_buddy_global);
+        case SHOOTDOWN_COALESCED:
+            return Atomic::load(per_cpu.counter_shootdown_coalesced);
+        case NUM_COUNTERS:
+            break;
+        }
+
+        return 0;
+    }
 };
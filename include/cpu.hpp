@@ -51,10 +51,12 @@ public:
         FEAT_HTT = 28,
         FEAT_VMX = 37,
         FEAT_PCID = 49,
+        FEAT_X2APIC = 53,
         FEAT_TSC_DEADLINE = 56,
         FEAT_XSAVE = 58,
         FEAT_FSGSBASE = 96,
         FEAT_SMEP = 103,
+        FEAT_ERMS = 105,
         FEAT_SMAP = 116,
         FEAT_1GB_PAGES = 154,
         FEAT_CMP_LEGACY = 161,
@@ -21,10 +21,15 @@
 #include "config.hpp"
 #include "gdt.hpp"
 #include "memory.hpp"
+#include "pairing_heap.hpp"
+#include "pcid_allocator.hpp"
 #include "rcu_list.hpp"
+#include "ready_queue.hpp"
 #include "rq.hpp"
+#include "slab_magazine.hpp"
 #include "types.hpp"
 #include "vmx_types.hpp"
+#include "xcall.hpp"
 
 class Ec;
 class Pd;
@@ -73,6 +78,11 @@ struct alignas(PAGE_SIZE) Per_cpu {
     // The current protection domain.
     Pd* pd_current;
 
+    // The PCIDs of the protection domains that ran on this CPU and the value
+    // of CR3 for the current protection domain.
+    Pcid_allocator<NUM_PCIDS> pd_pcids;
+    mword pd_host_cr3;
+
     // The current scheduling context.
     Sc* sc_current;
 
@@ -82,16 +92,19 @@ struct alignas(PAGE_SIZE) Per_cpu {
     // Ec-related variables;
     Ec* ec_idle_ec;
 
-    // The list of pending timeouts.
-    Timeout* timeout_list;
+    // Cross-CPU portal calls that wait for this CPU. See ec_xcall.cpp.
+    Xcall_queue ec_xcall_mailbox;
+    Xcall* ec_xcall_pending;
+    Ec* ec_xcall_proxy;
+
+    // The pending timeouts.
+    Pairing_heap<Timeout> timeout_heap;
     Timeout* timeout_budget;
 
     // Scheduling-related variables
     Rq sc_rq;
-    Sc* sc_list[NUM_PRIORITIES];
-    unsigned sc_prio_top;
+    Ready_queue<Sc, NUM_PRIORITIES> sc_ready;
     unsigned sc_ctr_link;
-    unsigned sc_ctr_loop;
 
     // VMX-related variables
     unsigned vmcs_vpid_ctr;
@@ -118,8 +131,17 @@ struct alignas(PAGE_SIZE) Per_cpu {
     uint32 vmcb_svm_version;
     uint32 vmcb_svm_feature;
 
+    // LAPIC-related variables
+    uint64 lapic_timer_deadline;
+
     // Statistics
     uint32 counter_tlb_shootdown;
+    uint64 counter_buddy_global;
+    uint64 counter_shootdown_coalesced;
+
+    // The TLB shootdown counters of remote CPUs as sampled by the last
+    // Space_mem::shootdown() on this CPU.
+    uint32 space_mem_shootdown_ctr[NUM_CPU];
 
     // CPU-related variables (that are not performance critical)
     uint32 cpu_features[9];
@@ -128,6 +150,19 @@ struct alignas(PAGE_SIZE) Per_cpu {
     // Machine-check variables
     unsigned mca_banks;
 
+    // Per-CPU object caches of the slab allocators. See Slab_cache.
+    Slab_magazine<16> slab_magazines[NUM_SLAB_MAGAZINES];
+
+    // Per-CPU caches of order-0 and order-1 pages. See Buddy.
+    Slab_magazine<16> buddy_page_cache[2];
+
+    // Pre-zeroed pages for FILL_0 allocations. See Buddy::refill_zero_pool.
+    void* buddy_zero_pool[NUM_ZERO_PAGES];
+    unsigned buddy_zero_pool_count;
+
+    // The last drain request handled by this CPU. See Buddy::drain_handler.
+    unsigned buddy_drained;
+
     // Read-copy update
     mword rcu_l_batch;
     mword rcu_c_batch;
@@ -148,7 +183,13 @@ class Cpulocal
 {
     static Per_cpu cpu[NUM_CPU];
 
+    static bool initialized;
+
 public:
+    // Returns true, if CPU-local memory can be accessed. This is only false
+    // during early boot before the BSP has set up its CPU-local memory.
+    static bool is_initialized() { return initialized; }
+
     static Per_cpu& get()
     {
         char* r;
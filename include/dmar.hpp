@@ -22,6 +22,7 @@
 
 #include "algorithm.hpp"
 #include "list.hpp"
+#include "lock_guard.hpp"
 #include "slab.hpp"
 #include "util.hpp"
 #include "x86.hpp"
@@ -49,6 +50,35 @@ public:
     Dmar_qi_tlb() : Dmar_qi(0x2 | 1UL << 4) {}
 };
 
+// Invalidates the IOTLB entries of one domain.
+class Dmar_qi_tlb_dom : public Dmar_qi
+{
+public:
+    Dmar_qi_tlb_dom(unsigned long did) : Dmar_qi(0x2 | 2UL << 4 | static_cast<uint64>(did) << 16) {}
+};
+
+// Invalidates the IOTLB entries of one domain for the naturally aligned
+// region of 2^am pages at addr.
+class Dmar_qi_tlb_page : public Dmar_qi
+{
+public:
+    Dmar_qi_tlb_page(unsigned long did, uint64 addr, unsigned am)
+        : Dmar_qi(0x2 | 3UL << 4 | static_cast<uint64>(did) << 16, addr | am)
+    {
+    }
+};
+
+// Writes data to the dword at addr, once all earlier descriptors have
+// completed.
+class Dmar_qi_wait : public Dmar_qi
+{
+public:
+    Dmar_qi_wait(uint32 data, uint64 addr)
+        : Dmar_qi(0x5 | 1UL << 5 | 1UL << 6 | static_cast<uint64>(data) << 32, addr)
+    {
+    }
+};
+
 class Dmar_qi_iec : public Dmar_qi
 {
 public:
@@ -106,10 +136,23 @@ private:
     Dmar_qi* invq;
     unsigned invq_idx;
 
+    // Protects the invalidation queue and the register-based invalidation
+    // interface, which are shared by all CPUs.
+    Spinlock qi_lock;
+
+    // The status data of the last wait descriptor that was queued and the
+    // status the hardware wrote last. Invalidations have completed, when
+    // both are equal.
+    uint32 qi_seq;
+    uint32 volatile qi_done;
+
     static Dmar_ctx* ctx;
     static Dmar_irt* irt;
     static uint32 gcmd;
 
+    // True, if any DMAR unit caches non-present and invalid entries.
+    static bool caching;
+
     static Dmar* list;
     static Slab_cache cache;
 
@@ -160,6 +203,13 @@ private:
 
     inline unsigned qi() const { return static_cast<unsigned>(ecap) & 0x2; }
 
+    inline bool cm() const { return cap & 0x80; }
+
+    inline bool psi() const { return cap & (1ULL << 39); }
+
+    // The largest address mask for page-selective invalidations.
+    inline unsigned mamv() const { return static_cast<unsigned>(cap >> 48) & 0x3f; }
+
     // Return the number of supported page table levels.
     int page_table_levels() const;
 
@@ -191,26 +241,51 @@ private:
             pause();
     }
 
+    // Queue a descriptor. The hardware only sees it after the next
+    // qi_fence(). Needs qi_lock.
     inline void qi_submit(Dmar_qi const& q)
     {
+        unsigned const next_idx{(invq_idx + 1) % cnt};
+
+        while (next_idx == read<uint64>(REG_IQH) >> 4)
+            pause();
+
         invq[invq_idx] = q;
-        invq_idx = (invq_idx + 1) % cnt;
-        write<uint64>(REG_IQT, invq_idx << 4);
+        invq_idx = next_idx;
     };
 
+    // Queue a wait descriptor and hand all queued descriptors to the
+    // hardware. Needs qi_lock.
+    inline void qi_fence()
+    {
+        qi_submit(Dmar_qi_wait(++qi_seq, Buddy::ptr_to_phys(const_cast<uint32*>(&qi_done))));
+        write<uint64>(REG_IQT, invq_idx << 4);
+    }
+
+    // Wait for all descriptors that were handed to the hardware so far.
     inline void qi_wait()
     {
-        for (uint64 v = read<uint64>(REG_IQT); v != read<uint64>(REG_IQH); pause())
-            ;
+        uint32 const seq{Atomic::load(qi_seq)};
+
+        while (static_cast<int32>(qi_done - seq) < 0)
+            pause();
     }
 
     inline void flush_ctx()
     {
         if (qi()) {
-            qi_submit(Dmar_qi_ctx());
-            qi_submit(Dmar_qi_tlb());
+            {
+                Lock_guard<Spinlock> guard(qi_lock);
+
+                qi_submit(Dmar_qi_ctx());
+                qi_submit(Dmar_qi_tlb());
+                qi_fence();
+            }
+
             qi_wait();
         } else {
+            Lock_guard<Spinlock> guard(qi_lock);
+
             write<uint64>(REG_CCMD, 1ULL << 63 | 1ULL << 61);
             while (read<uint64>(REG_CCMD) & (1ULL << 63))
                 pause();
@@ -220,6 +295,8 @@ private:
         }
     }
 
+    void submit_flush_tlb(unsigned long, mword, mword);
+
     void fault_handler();
 
     /// Configure the basic DMAR unit registers.
@@ -255,9 +332,18 @@ public:
 
     static bool qie() { return gcmd & GCMD_QIE; }
 
-    static void flush_all_contexts()
+    // Returns true, if the IOTLB needs to be flushed after non-present
+    // entries of the DMA page tables become present.
+    static bool caching_mode() { return caching; }
+
+    // Invalidate the IOTLB entries of a domain for the naturally aligned
+    // region of 2^order bytes at base on all DMAR units.
+    static void flush_tlb(unsigned long did, mword base, mword order)
     {
-        for_each(Forward_list_range{list}, mem_fn_closure(&Dmar::flush_ctx)());
+        // Each unit starts working on its invalidations before we wait for
+        // any of them.
+        for_each(Forward_list_range{list}, mem_fn_closure(&Dmar::submit_flush_tlb)(did, base, order));
+        for_each(Forward_list_range{list}, mem_fn_closure(&Dmar::qi_wait)());
     }
 
     void assign(unsigned long, Pd*);
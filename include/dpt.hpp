@@ -41,6 +41,10 @@ public:
 
         PTE_S = 1UL << 7,
         PTE_P = PTE_R | PTE_W,
+
+        // DMA page tables have no accessed and dirty bits.
+        PTE_A = 0,
+        PTE_D = 0,
     };
 
     static constexpr pte_t mask{PTE_R | PTE_W};
@@ -27,6 +27,7 @@
 
 #include "cpulocal.hpp"
 #include "fpu.hpp"
+#include "hazards.hpp"
 #include "lock_guard.hpp"
 #include "math.hpp"
 #include "mtd.hpp"
@@ -54,6 +55,7 @@
 // Recall exception index for vCPUs.
 #define VMI_RECALL (NUM_VMI - 1)
 
+class Pt;
 class Utcb;
 
 class Ec : public Typed_kobject<Kobject::Type::EC>, public Refcount, public Queue<Sc>
@@ -77,6 +79,16 @@ private:
     Refptr<Pd> pd_user_page;
 
     Ec* partner{nullptr};
+
+    // The first EC of the helping chain this EC is part of and the number of
+    // partner links from there to this EC. An EC that is not called by anyone
+    // is the root of its own chain.
+    Ec* chain_root{this};
+    unsigned chain_depth{0};
+
+    // The last EC of the helping chain, which is the one that actually runs.
+    // Only valid if this EC is the root of its chain.
+    Ec* chain_tail{this};
     Ec* prev{nullptr};
     Ec* next{nullptr};
     union {
@@ -89,6 +101,9 @@ private:
     unsigned const evt{0};
     Timeout_hypercall timeout{this};
 
+    // The portal call this EC waits for, if it called a portal on another CPU.
+    Xcall xcall;
+
     // Virtual Address of the UTCB in userspace.
     mword user_utcb{0};
 
@@ -174,6 +189,27 @@ private:
 
     inline Exc_regs* exc_regs() { return &regs; }
 
+    // Append the given EC to the helping chain that ends with this EC.
+    inline void chain_append(Ec* p)
+    {
+        assert(chain_root->chain_tail == this);
+        assert(p->chain_root == p and p->chain_tail == p);
+
+        p->chain_root = chain_root;
+        p->chain_depth = chain_depth + 1;
+        chain_root->chain_tail = p;
+    }
+
+    // Remove the partner of this EC from the end of the helping chain.
+    inline void chain_truncate()
+    {
+        assert(chain_root->chain_tail == partner);
+
+        chain_root->chain_tail = this;
+        partner->chain_root = partner;
+        partner->chain_depth = 0;
+    }
+
     inline void set_partner(Ec* p)
     {
         partner = p;
@@ -182,6 +218,7 @@ private:
         partner->rcap = this;
         ok = partner->rcap->add_ref();
         assert(ok);
+        chain_append(p);
         Sc::ctr_link()++;
     }
 
@@ -193,6 +230,7 @@ private:
             assert(!last);
             partner->rcap = nullptr;
         }
+        chain_truncate();
         bool last = partner->del_ref();
         assert(!last);
         partner = nullptr;
@@ -213,6 +251,27 @@ private:
     NORETURN
     static void idle();
 
+    CPULOCAL_REMOTE_ACCESSOR(ec, xcall_mailbox);
+    CPULOCAL_ACCESSOR(ec, xcall_pending);
+    CPULOCAL_ACCESSOR(ec, xcall_proxy);
+
+    // Call the given portal on the CPU of its handler and wait for the reply.
+    NORETURN
+    static void send_xcall(Pt*);
+
+    // The continuation of the xcall proxy, which performs the calls that
+    // remote CPUs have sent to this CPU.
+    NORETURN
+    static void xcall_serve();
+
+    // Reply to a caller on another CPU.
+    NORETURN
+    static void xcall_reply();
+
+    // Hand the result of a cross-CPU call to the caller and drop the
+    // references of the request.
+    static void xcall_complete(Xcall*);
+
 public:
     // Capability permission bitmask.
     enum
@@ -246,7 +305,7 @@ public:
 
     inline void add_tsc_offset(uint64 tsc) { regs.add_tsc_offset(tsc); }
 
-    inline bool blocked() const { return next || !cont; }
+    inline bool blocked() const { return next || !cont || Atomic::load(xcall.waiting); }
 
     inline void set_timeout(uint64 t, Sm* s)
     {
@@ -332,10 +391,16 @@ public:
 
             current()->cont = c;
 
-            if (EXPECT_TRUE(++Sc::ctr_loop() < 100))
-                activate();
+            // ECs can keep helping each other without ever blocking, e.g. if
+            // they wait for each other in a cycle. Open a short interrupt
+            // window and go through the scheduler when it is time, so this
+            // never ties up the CPU.
+            asm volatile("sti; nop; cli" : : : "memory");
+
+            if (EXPECT_FALSE(Cpu::hazard() & HZD_SCHED))
+                Sc::schedule();
 
-            die("Livelock");
+            activate();
         }
     }
 
@@ -358,12 +423,22 @@ public:
     }
 
     inline void release(void (*c)())
+    {
+        release(c, [] {});
+    }
+
+    // Release this EC and call unblock() in the same critical section. An
+    // EC that is blocked by other state than its continuation uses this, so
+    // that block_sc() cannot see the state change without the release.
+    template <typename FN> inline void release(void (*c)(), FN const& unblock)
     {
         if (c)
             cont = c;
 
         Lock_guard<Spinlock> guard(lock);
 
+        unblock();
+
         for (Sc* s; dequeue(s = head());) {
             if (EXPECT_TRUE(!s->last_ref()) || s->ec->partner) {
                 s->remote_enqueue(false);
@@ -386,6 +461,9 @@ public:
 
     template <Sys_regs::Status S, bool T = false> NOINLINE NORETURN static void sys_finish();
 
+    NORETURN
+    static void sys_finish(Sys_regs::Status);
+
     NORETURN
     void activate();
 
@@ -446,6 +524,9 @@ public:
     NORETURN
     static void sys_sm_ctrl();
 
+    NORETURN
+    static void sys_sm_ctrl_drain();
+
     NORETURN
     static void sys_assign_pci();
 
@@ -461,6 +542,28 @@ public:
     NORETURN
     static void sys_machine_ctrl_update_microcode();
 
+    NORETURN
+    static void sys_machine_ctrl_read_counter();
+
+    NORETURN
+    static void sys_machine_ctrl_trace();
+
+    NORETURN
+    static void sys_multicall();
+
+    NORETURN
+    static void sys_dirty_log();
+
+    // The implementation of hypercalls that can be part of a multicall. They
+    // take their arguments from the register state of the current EC and
+    // return the status instead of returning to userspace. TLB shootdowns
+    // are not performed, but accumulated in the passed Tlb_cleanup object.
+    static Sys_regs::Status do_create_pt();
+    static Sys_regs::Status do_create_sm();
+    static Sys_regs::Status do_revoke(Tlb_cleanup&);
+    static Sys_regs::Status do_pd_ctrl_delegate(Tlb_cleanup&);
+    static Sys_regs::Status do_multicall_op(Tlb_cleanup&);
+
     NORETURN
     static void root_invoke();
 
@@ -479,6 +582,11 @@ public:
 
     static void idl_handler();
 
+    // Create the xcall proxy of the current CPU. See ec_xcall.cpp.
+    static void create_xcall_proxy();
+
+    static void xcall_handler();
+
     static inline void* operator new(size_t) { return cache.alloc(); }
 
     static inline void operator delete(void* ptr) { cache.free(ptr); }
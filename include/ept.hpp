@@ -39,11 +39,15 @@ private:
         INVEPT_SINGLE_CONTEXT = 1,
     };
 
+    // Whether the CPU maintains accessed and dirty bits in the EPT.
+    static bool ad_bits;
+
     // EPTP constants
     enum
     {
         EPTP_WB = 6,
         EPTP_WALK_LENGTH_SHIFT = 3,
+        EPTP_AD = 1U << 6,
     };
 
 public:
@@ -71,14 +75,25 @@ public:
 
         PTE_I = 1UL << 6,
         PTE_S = 1UL << 7,
+
+        // Only set by the CPU, if accessed and dirty bits are enabled.
+        PTE_A = 1UL << 8,
+        PTE_D = 1UL << 9,
     };
 
-    static constexpr pte_t mask{PTE_R | PTE_W | PTE_X | PTE_I | PTE_MT_MASK};
+    static constexpr pte_t mask{PTE_R | PTE_W | PTE_X | PTE_I | PTE_MT_MASK | PTE_A | PTE_D};
     static constexpr pte_t all_rights{PTE_R | PTE_W | PTE_X};
 
     // Adjust the number of leaf levels to the given value.
     static void set_supported_leaf_levels(level_t level);
 
+    // Let the CPU maintain accessed and dirty bits. This has to happen
+    // before the first EPT is used.
+    static void enable_ad_bits() { ad_bits = true; }
+
+    // Returns true, if the CPU maintains dirty bits in the EPT.
+    static bool has_ad_bits() { return ad_bits; }
+
     // Create a page table from scratch.
     Ept() : Ept_page_table(4, supported_leaf_levels) {}
 
@@ -105,6 +120,7 @@ public:
     // Return a VMCS EPT pointer to this EPT.
     uint64 vmcs_eptp() const
     {
-        return static_cast<uint64>(root()) | (max_levels() - 1) << EPTP_WALK_LENGTH_SHIFT | EPTP_WB;
+        return static_cast<uint64>(root()) | (max_levels() - 1) << EPTP_WALK_LENGTH_SHIFT | EPTP_WB |
+               (ad_bits ? EPTP_AD : 0);
     }
 };
@@ -162,16 +162,21 @@ private:
         assert_slow(cur_level >= 0 and cur_level < max_levels_);
 
         pte_t const entry{memory_.read(pte_p + virt_to_index(cur_level, vaddr))};
-        phys_t const phys{entry & ~ATTR::mask};
 
         if (is_leaf(cur_level, entry)) {
-            ord_t const map_order{level_order(cur_level)};
-            ENTRY const mask{(static_cast<ENTRY>(1) << map_order) - 1};
-
-            return Mapping{vaddr & ~mask, phys & ~mask, entry & ATTR::mask, map_order};
+            return leaf_mapping(vaddr, entry, cur_level);
         }
 
-        return lookup(vaddr, page_alloc_.phys_to_pointer(phys), cur_level - 1);
+        return lookup(vaddr, page_alloc_.phys_to_pointer(entry & ~ATTR::mask), cur_level - 1);
+    }
+
+    // Return the mapping that the given leaf entry creates for vaddr.
+    Mapping leaf_mapping(virt_t vaddr, pte_t entry, level_t cur_level) const
+    {
+        ord_t const map_order{level_order(cur_level)};
+        ENTRY const mask{(static_cast<ENTRY>(1) << map_order) - 1};
+
+        return Mapping{vaddr & ~mask, (entry & ~ATTR::mask) & ~mask, entry & ATTR::mask, map_order};
     }
 
     // Use a superpage from the given level to fill out a new page table one
@@ -359,6 +364,146 @@ private:
         flush_cache_entries(table + offset, static_cast<size_t>(1) << updated_order);
     }
 
+    // See the description of the public version of this function below.
+    // Unlike there, last is the last virtual address of the range.
+    template <typename FN>
+    void for_each_mapping(pte_pointer_t table, level_t cur_level, virt_t start, virt_t last, FN const& fn)
+    {
+        assert_slow(cur_level >= 0 and cur_level < max_levels_);
+        assert_slow(start <= last);
+
+        ord_t const entry_order{level_order(cur_level)};
+        virt_t const entry_mask{(static_cast<virt_t>(1) << entry_order) - 1};
+
+        size_t const first_idx{virt_to_index(cur_level, start)};
+        size_t const last_idx{virt_to_index(cur_level, last)};
+
+        for (size_t i{first_idx}; i <= last_idx; i++) {
+            pte_pointer_t const pte_p{table + i};
+            pte_t const entry{memory_.read(pte_p)};
+            virt_t const entry_vaddr{(start & ~entry_mask) + (static_cast<virt_t>(i - first_idx) << entry_order)};
+
+            if (not(entry & ATTR::PTE_P)) {
+                continue;
+            }
+
+            if (is_leaf(cur_level, entry)) {
+                fn(pte_p, leaf_mapping(entry_vaddr, entry, cur_level));
+                continue;
+            }
+
+            for_each_mapping(page_alloc_.phys_to_pointer(entry & ~ATTR::mask), cur_level - 1,
+                             max(start, entry_vaddr), min(last, entry_vaddr + entry_mask), fn);
+        }
+    }
+
+    // The accessed and dirty bits, which the CPU sets on its own.
+    static constexpr pte_t ad_bits() { return ATTR::PTE_A | ATTR::PTE_D; }
+
+    // Returns the superpage entry one level above cur_level that maps the
+    // same memory as all entries of the given table or zero, if there is
+    // none. This is the case, if all entries are present leaves that map a
+    // contiguous and aligned physical range with identical attributes apart
+    // from the accessed and dirty bits.
+    //
+    // The superpage is accessed, if any entry is. It is dirty, if any entry
+    // is or if it is writable. Until the TLB flush, the CPU may still set
+    // dirty bits in the old table, which we never look at again. So a
+    // writable superpage has to be considered written.
+    pte_t superpage_for(pte_pointer_t table, level_t cur_level)
+    {
+        ord_t const entry_order{level_order(cur_level)};
+        ENTRY const superpage_mask{(static_cast<ENTRY>(1) << level_order(cur_level + 1)) - 1};
+
+        pte_t const raw_first{memory_.read(table)};
+        pte_t const first{raw_first & ~ad_bits()};
+
+        if (not(first & ATTR::PTE_P) or not is_leaf(cur_level, first)) {
+            return 0;
+        }
+
+        pte_t const attr{first & ATTR::mask};
+        phys_t const base{first & ~ATTR::mask & ~(cur_level > 0 ? static_cast<pte_t>(ATTR::PTE_S) : 0)};
+
+        if (base & superpage_mask) {
+            return 0;
+        }
+
+        pte_t ad{(raw_first & ad_bits()) | (attr & ATTR::PTE_W ? static_cast<pte_t>(ATTR::PTE_D) : 0)};
+
+        // Tables that are populated in ascending order are usually missing
+        // their last entries, so we look at these first.
+        for (size_t i{(static_cast<size_t>(1) << BITS_PER_LEVEL) - 1}; i > 0; i--) {
+            pte_t const entry{memory_.read(table + i)};
+
+            if ((entry & ~ad_bits()) != (first | (static_cast<ENTRY>(i) << entry_order))) {
+                return 0;
+            }
+
+            ad |= entry & ad_bits();
+        }
+
+        return base | attr | ad | ATTR::PTE_S;
+    }
+
+    // Replace the table referenced by the entry at pte_p with a superpage,
+    // if possible. Returns true, if the entry is a leaf afterwards.
+    bool promote_table(DEFERRED_CLEANUP& cleanup_state, pte_pointer_t pte_p, pte_t table_pte, level_t cur_level)
+    {
+        pte_pointer_t const table{page_alloc_.phys_to_pointer(table_pte & ~ATTR::mask)};
+        pte_t const superpage{superpage_for(table, cur_level - 1)};
+
+        if (superpage == 0 or not memory_.cmp_swap(pte_p, table_pte, superpage)) {
+            return false;
+        }
+
+        flush_cache_entries(pte_p, 1);
+
+        // An update may have modified the table while we were looking at it.
+        // In this case, put the table back. The CPU may have set accessed
+        // and dirty bits in the meantime, which does not matter.
+        if ((superpage_for(table, cur_level - 1) & ~ad_bits()) != (superpage & ~ad_bits()) and
+            memory_.cmp_swap(pte_p, superpage, table_pte)) {
+            flush_cache_entries(pte_p, 1);
+            return false;
+        }
+
+        cleanup(cleanup_state, table_pte, cur_level);
+        return true;
+    }
+
+    // See the description of the public version of this function below.
+    // Returns true, if the entry for vaddr in the given table is a leaf
+    // afterwards.
+    bool promote(DEFERRED_CLEANUP& cleanup_state, virt_t vaddr, pte_pointer_t table, level_t cur_level,
+                 bool& promoted)
+    {
+        assert_slow(cur_level >= 0 and cur_level < max_levels_);
+
+        if (cur_level == 0) {
+            return true;
+        }
+
+        pte_pointer_t const pte_p{table + virt_to_index(cur_level, vaddr)};
+        pte_t const entry{memory_.read(pte_p)};
+
+        if (is_leaf(cur_level, entry)) {
+            return true;
+        }
+
+        if (not promote(cleanup_state, vaddr, page_alloc_.phys_to_pointer(entry & ~ATTR::mask), cur_level - 1,
+                        promoted)) {
+            return false;
+        }
+
+        if (cur_level >= leaf_levels_ or not promote_table(cleanup_state, pte_p, entry, cur_level)) {
+            return false;
+        }
+
+        promoted = true;
+        return true;
+    }
+
 public:
     // The maximum possible mapping order.
     ord_t max_order() const { return max_levels_ * BITS_PER_LEVEL + PAGE_BITS; }
@@ -423,6 +568,73 @@ public:
         return walk_down_and_split(cleanup, vaddr, to_level, root_, max_levels_ - 1, create);
     }
 
+    // Returns the page table entry for the given virtual address at the
+    // given level or zero, if the page table walk ends above this level.
+    //
+    // Unlike walk_down_and_split, this does not modify the page table.
+    pte_t entry_at(virt_t vaddr, level_t level)
+    {
+        assert_slow(root_ != nullptr);
+        assert_slow(level >= 0 and level < max_levels_);
+
+        pte_pointer_t table{root_};
+
+        for (level_t cur_level{max_levels_ - 1};; cur_level--) {
+            pte_t const entry{memory_.read(table + virt_to_index(cur_level, vaddr))};
+
+            if (cur_level == level) {
+                return entry;
+            }
+
+            if (is_leaf(cur_level, entry)) {
+                return 0;
+            }
+
+            table = page_alloc_.phys_to_pointer(entry & ~ATTR::mask);
+        }
+    }
+
+    // Install an entry that points to a page table of another page table
+    // hierarchy at the given level.
+    //
+    // The page table it points to is shared afterwards, i.e. changes to its
+    // mappings are visible in both hierarchies. The caller has to remove
+    // the entry with unlink_table before this page table is destroyed,
+    // because the shared page table would be freed otherwise.
+    void link_table(DEFERRED_CLEANUP& cleanup_state, virt_t vaddr, level_t level, pte_t entry)
+    {
+        assert(level > 0 and level < max_levels_ - 1);
+        assert(not is_leaf(level, entry));
+
+        pte_pointer_t const table{walk_down_and_split(cleanup_state, vaddr, level, true)};
+        pte_pointer_t const pte_p{table + virt_to_index(level, vaddr)};
+
+        cleanup(cleanup_state, memory_.exchange(pte_p, entry), level);
+        flush_cache_entries(pte_p, 1);
+    }
+
+    // Remove an entry installed by link_table without freeing the page
+    // table it points to. Returns the removed entry or zero, if there was
+    // no page table at this place.
+    pte_t unlink_table(DEFERRED_CLEANUP& cleanup_state, virt_t vaddr, level_t level)
+    {
+        assert(level > 0 and level < max_levels_ - 1);
+
+        // Check first, so we don't split superpages on the way down.
+        if (is_leaf(level, entry_at(vaddr, level))) {
+            return 0;
+        }
+
+        pte_pointer_t const table{walk_down_and_split(cleanup_state, vaddr, level, false)};
+        pte_pointer_t const pte_p{table + virt_to_index(level, vaddr)};
+        pte_t const old_entry{memory_.exchange(pte_p, 0)};
+
+        cleanup_state.flush_tlb_later();
+        flush_cache_entries(pte_p, 1);
+
+        return old_entry;
+    }
+
     // Creates mappings in the page table. Returns true, if a TLB shootdown
     // is necessary.
     NOINLINE void update(DEFERRED_CLEANUP& cleanup, Mapping const& map)
@@ -465,6 +677,200 @@ public:
         return cleanup;
     }
 
+    // Merge page tables on the way to the given virtual address back into
+    // superpages.
+    //
+    // update() splits superpages, but never merges the resulting page
+    // tables again. This function replaces each page table whose entries
+    // map a contiguous, aligned physical range with identical attributes
+    // by a superpage, starting from the lowest level. The page tables that
+    // are freed this way are handed to cleanup_state.
+    //
+    // Unlike update(), this function is not safe against concurrent updates
+    // of the same page tables, because these may write to a page table after
+    // it was replaced. The caller needs to serialize all updates of a page
+    // table that is promoted.
+    //
+    // Returns true, if any page table was merged.
+    bool promote(DEFERRED_CLEANUP& cleanup_state, virt_t vaddr)
+    {
+        assert_slow(root_ != nullptr);
+
+        bool promoted{false};
+        promote(cleanup_state, vaddr, root_, max_levels_ - 1, promoted);
+
+        return promoted;
+    }
+
+    // Call fn(pte_p, mapping) for each present leaf entry that maps memory
+    // in [start, end). pte_p points to the entry and mapping is what the
+    // entry maps. The mapping may extend beyond the range.
+    //
+    // The page table is not modified, but fn may change the entry it is
+    // called for.
+    template <typename FN> void for_each_mapping(virt_t start, virt_t end, FN const& fn)
+    {
+        assert_slow(root_ != nullptr);
+
+        if (start < end) {
+            for_each_mapping(root_, max_levels_ - 1, start, end - 1, fn);
+        }
+    }
+
+    // Atomically clear the dirty bits of all mappings in [start, end).
+    //
+    // Calls mark(mapping) for each mapping whose dirty bit was set. Since the
+    // TLB may still consider these mappings dirty, a TLB flush is requested
+    // via cleanup_state. Writes that happen before the flush are to memory
+    // that was reported as dirty.
+    template <typename FN> void clear_dirty(DEFERRED_CLEANUP& cleanup_state, virt_t start, virt_t end, FN const& mark)
+    {
+        for_each_mapping(start, end, [this, &cleanup_state, &mark](pte_pointer_t pte_p, Mapping const& m) {
+            for (;;) {
+                pte_t const entry{memory_.read(pte_p)};
+
+                if (not(entry & ATTR::PTE_P) or not(entry & ATTR::PTE_D)) {
+                    return;
+                }
+
+                if (memory_.cmp_swap(pte_p, entry, entry & ~static_cast<pte_t>(ATTR::PTE_D))) {
+                    break;
+                }
+            }
+
+            flush_cache_entries(pte_p, 1);
+            cleanup_state.flush_tlb_later();
+            mark(m);
+        });
+    }
+
+    // Remembers the page tables of the last walk to speed up lookups and
+    // updates of nearby virtual addresses.
+    //
+    // Every lookup() and update() of a page table starts its walk at the
+    // root. A cursor instead starts at the lowest page table of its last
+    // walk that also covers the new virtual address. Walking a range of
+    // mappings in ascending order thus touches each page table only once.
+    //
+    // Page tables that are removed by concurrent updates are only reused
+    // after the TLB flush of that update. The cursor is thus meant to be
+    // used for the duration of a single operation and not kept around.
+    class Cursor
+    {
+        // We cache the page tables below the root. All our page tables have
+        // four levels. Delegations keep several cursors on the stack, so we
+        // don't reserve space for more.
+        static constexpr level_t MAX_CACHED_LEVELS{3};
+
+        this_t& pt_;
+
+        // The virtual address of the last walk.
+        virt_t vaddr_{0};
+
+        // tables_[l] holds the page table at level l that covers vaddr_ for
+        // all levels from valid_level_ up to the root.
+        level_t valid_level_;
+
+        pte_pointer_t tables_[MAX_CACHED_LEVELS];
+
+        level_t root_level() const { return pt_.max_levels_ - 1; }
+
+        pte_pointer_t table(level_t level) const { return level == root_level() ? pt_.root_ : tables_[level]; }
+
+        // Returns the lowest level whose cached page table covers vaddr and
+        // makes vaddr the address of the last walk.
+        level_t reuse(virt_t vaddr)
+        {
+            level_t level{valid_level_};
+
+            while (level < root_level() and
+                   (vaddr >> pt_.level_order(level + 1)) != (vaddr_ >> pt_.level_order(level + 1))) {
+                level++;
+            }
+
+            vaddr_ = vaddr;
+            valid_level_ = level;
+
+            return level;
+        }
+
+        // Forget cached page tables below the given level.
+        void invalidate_below(level_t level) { valid_level_ = max(valid_level_, level); }
+
+    public:
+        // Return the mapping at the given virtual address. See
+        // Generic_page_table::lookup.
+        WARN_UNUSED_RESULT Mapping lookup(virt_t vaddr)
+        {
+            level_t level{reuse(vaddr)};
+            pte_pointer_t table_p{table(level)};
+
+            for (;; level--) {
+                pte_t const entry{pt_.memory_.read(table_p + pt_.virt_to_index(level, vaddr))};
+
+                if (pt_.is_leaf(level, entry)) {
+                    return pt_.leaf_mapping(vaddr, entry, level);
+                }
+
+                table_p = pt_.page_alloc_.phys_to_pointer(entry & ~ATTR::mask);
+                tables_[level - 1] = table_p;
+                valid_level_ = level - 1;
+            }
+        }
+
+        // Create mappings in the page table. See Generic_page_table::update.
+        void update(DEFERRED_CLEANUP& cleanup_state, Mapping const& map)
+        {
+            assert_slow(map.order >= PAGE_BITS and map.order <= pt_.max_order());
+            assert_slow((map.attr & ~ATTR::mask) == 0);
+
+            level_t const modified_level{(map.order - PAGE_BITS) / BITS_PER_LEVEL};
+            level_t level{max(reuse(map.vaddr), modified_level)};
+            pte_pointer_t table_p{table(level)};
+
+            for (; level > modified_level; level--) {
+                table_p = pt_.walk_down_and_split(cleanup_state, map.vaddr, level - 1, table_p, level,
+                                                  map.present());
+
+                if (table_p == nullptr) {
+                    // There is nothing to unmap.
+                    return;
+                }
+
+                tables_[level - 1] = table_p;
+                valid_level_ = min(valid_level_, level - 1);
+            }
+
+            pt_.fill_entries(cleanup_state, table_p, modified_level, map);
+
+            // Filling in entries may have replaced the page tables below.
+            invalidate_below(modified_level);
+        }
+
+        // Merge page tables back into superpages. See
+        // Generic_page_table::promote.
+        bool promote(DEFERRED_CLEANUP& cleanup_state, virt_t vaddr)
+        {
+            bool const promoted{pt_.promote(cleanup_state, vaddr)};
+
+            if (promoted) {
+                invalidate_below(root_level());
+            }
+
+            return promoted;
+        }
+
+        // Forget all cached page tables. This is needed when other CPUs may
+        // have replaced page tables since the last walk.
+        void reset() { valid_level_ = root_level(); }
+
+        explicit Cursor(this_t& pt) : pt_{pt}, valid_level_{pt.max_levels_ - 1}, tables_{}
+        {
+            assert(pt.max_levels_ - 1 <= MAX_CACHED_LEVELS);
+            assert_slow(pt.root_ != nullptr);
+        }
+    };
+
     // Replace a single non-existing or read-only page at the lowest page
     // table level with a new mapping.
     //
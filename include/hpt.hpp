@@ -97,9 +97,16 @@ public:
     // Adjust the number of leaf levels to the given value.
     static void set_supported_leaf_levels(level_t level);
 
-    // Return a structural copy of this page table for the given virtual
-    // address range.
-    Hpt deep_copy(mword vaddr_start, mword vaddr_end);
+    // Make the kernel mappings of src part of this page table.
+    //
+    // Instead of copying the mappings, this page table references the page
+    // table of src that holds them. Kernel mappings that src gains later
+    // are thus visible here as well. Call unshare_kernel before this page
+    // table is destroyed.
+    void share_kernel(Hpt& src);
+
+    // Remove the reference to the kernel page table of src.
+    void unshare_kernel(Hpt& src);
 
     void make_current(mword pcid)
     {
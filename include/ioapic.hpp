@@ -26,6 +26,7 @@
 #include "hip.hpp"
 #include "list.hpp"
 #include "lock_guard.hpp"
+#include "spinlock.hpp"
 #include "static_vector.hpp"
 
 class Ioapic : public Forward_list<Ioapic>
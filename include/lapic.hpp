@@ -24,6 +24,7 @@
 #pragma once
 
 #include "compiler.hpp"
+#include "cpulocal.hpp"
 #include "memory.hpp"
 #include "msr.hpp"
 #include "x86.hpp"
@@ -74,16 +75,32 @@ private:
         DSH_EXC_SELF = 3U << 18,
     };
 
+    // In x2APIC mode, the registers are MSRs instead of MMIO.
+    static inline Msr::Register x2apic_msr(Register reg)
+    {
+        return static_cast<Msr::Register>(Msr::IA32_EXT_XAPIC + reg);
+    }
+
     static inline uint32 read(Register reg)
     {
+        if (x2apic)
+            return static_cast<uint32>(Msr::read(x2apic_msr(reg)));
+
         return *reinterpret_cast<uint32 volatile*>(CPU_LOCAL_APIC + (reg << 4));
     }
 
     static inline void write(Register reg, uint32 val)
     {
-        *reinterpret_cast<uint32 volatile*>(CPU_LOCAL_APIC + (reg << 4)) = val;
+        if (x2apic)
+            Msr::write(x2apic_msr(reg), val);
+        else
+            *reinterpret_cast<uint32 volatile*>(CPU_LOCAL_APIC + (reg << 4)) = val;
     }
 
+    // The deadline that is currently programmed into the timer or 0, if the
+    // timer is not armed.
+    CPULOCAL_ACCESSOR(lapic, timer_deadline);
+
     static inline void set_lvt(Register reg, Delivery_mode dlv, unsigned vector, unsigned misc = 0)
     {
         write(reg, misc | dlv | vector);
@@ -104,6 +121,9 @@ public:
     static unsigned freq_bus;
     static bool use_tsc_timer;
 
+    // Whether the LAPIC is accessed via MSRs (x2APIC mode) instead of MMIO.
+    static bool x2apic;
+
     // Number of CPUs that still need to be parked.
     //
     // See park_all_but_self.
@@ -116,7 +136,7 @@ public:
     /// \see park_all_but_self
     static inline park_fn park_function = nullptr;
 
-    static inline unsigned id() { return read(LAPIC_IDR) >> 24 & 0xff; }
+    static inline unsigned id() { return x2apic ? read(LAPIC_IDR) : read(LAPIC_IDR) >> 24 & 0xff; }
 
     // This is a special version of id() that already works when the LAPIC
     // is not mapped yet.
@@ -137,6 +157,13 @@ public:
 
     static inline void set_timer(uint64 tsc)
     {
+        // Timeouts and the scheduler often ask for the deadline that is
+        // already programmed. Avoid the expensive MSR or MMIO write then.
+        if (tsc == timer_deadline())
+            return;
+
+        timer_deadline() = tsc;
+
         if (not use_tsc_timer) {
             uint64 now = rdtsc();
             uint32 icr;
@@ -173,6 +200,12 @@ public:
 
     static void send_ipi(unsigned, unsigned, Delivery_mode = DLV_FIXED, Shorthand = DSH_NONE);
 
+    // Send a fixed IPI to all CPUs except the current one.
+    //
+    // This uses the destination shorthand and thus costs a single ICR
+    // write regardless of the number of CPUs in the system.
+    static void send_ipi_all_but_self(unsigned vector) { send_ipi(0, vector, DLV_FIXED, DSH_EXC_SELF); }
+
     // Stop all CPUs except the current one.
     //
     // Parked CPUs execute the passed function and all but the calling CPU
@@ -0,0 +1,74 @@
+/*
+ * Lock-Free Multi-Producer Single-Consumer Queue
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include "atomic.hpp"
+#include "compiler.hpp"
+
+// An intrusive queue that any number of CPUs can add elements to without
+// taking a lock, while a single consumer takes all elements out at once.
+//
+// Elements of type T need a next pointer that is accessible to this class.
+// The pointer is only used while the element is in this queue.
+//
+// Producers push elements onto a stack with a compare-and-swap. The consumer
+// takes the whole stack with a single exchange and reverses it, so elements
+// are handed out in the order they were added. Because the consumer never
+// removes individual elements, there is no ABA problem.
+template <typename T> class Mpsc_queue
+{
+    T* head_;
+
+public:
+    // Add an element to the queue.
+    //
+    // Returns true, if the queue was empty before. Only in this case does the
+    // consumer need to be notified, because all other elements will be picked
+    // up together with the first one.
+    bool enqueue(T* t)
+    {
+        T* old;
+
+        do {
+            old = Atomic::load(head_);
+            t->next = old;
+        } while (not Atomic::cmp_swap(head_, old, t));
+
+        return old == nullptr;
+    }
+
+    // Remove all elements from the queue.
+    //
+    // Returns a list of the removed elements linked via their next pointers in
+    // the order they were enqueued or nullptr, if the queue was empty.
+    T* dequeue_all()
+    {
+        T* list{Atomic::exchange(head_, static_cast<T*>(nullptr))};
+        T* reversed{nullptr};
+
+        while (list) {
+            T* next{list->next};
+
+            list->next = reversed;
+            reversed = list;
+            list = next;
+        }
+
+        return reversed;
+    }
+
+    Mpsc_queue() : head_{nullptr} {}
+};
@@ -0,0 +1,155 @@
+/*
+ * Intrusive Pairing Heap
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include "assert.hpp"
+#include "compiler.hpp"
+
+// A min-heap of elements ordered by their time member.
+//
+// Elements of type T need prev, next and child pointers and a time member that
+// are accessible to this class. The children of an element form a list via
+// their next pointers. The prev pointer of the first child points to its
+// parent, all other prev pointers point to the left sibling.
+//
+// Insertion and finding the minimum are O(1). Removing any element is
+// O(log n) amortized. Nothing here recurses, so the stack usage is constant
+// regardless of the shape of the heap.
+template <typename T> class Pairing_heap
+{
+    T* root_;
+
+    // Combine two heaps. Both arguments need to be roots without siblings.
+    static T* meld(T* a, T* b)
+    {
+        if (not a) {
+            return b;
+        }
+
+        if (not b) {
+            return a;
+        }
+
+        if (b->time < a->time) {
+            T* tmp{a};
+            a = b;
+            b = tmp;
+        }
+
+        // Make b the first child of a.
+        b->prev = a;
+        b->next = a->child;
+
+        if (a->child) {
+            a->child->prev = b;
+        }
+
+        a->child = b;
+
+        return a;
+    }
+
+    // Combine a list of siblings into a single heap using the standard
+    // two-pass pairing strategy.
+    static T* merge_pairs(T* first)
+    {
+        // First pass: meld pairs from left to right and push the results onto
+        // a stack that is linked via next pointers.
+        T* pairs{nullptr};
+
+        while (first) {
+            T* a{first};
+            T* b{a->next};
+
+            first = b ? b->next : nullptr;
+
+            a->prev = a->next = nullptr;
+
+            if (b) {
+                b->prev = b->next = nullptr;
+            }
+
+            T* m{meld(a, b)};
+
+            m->next = pairs;
+            pairs = m;
+        }
+
+        // Second pass: meld the pairs from right to left.
+        T* result{nullptr};
+
+        while (pairs) {
+            T* p{pairs};
+
+            pairs = p->next;
+            p->next = nullptr;
+
+            result = meld(result, p);
+        }
+
+        return result;
+    }
+
+public:
+    // Returns the element with the smallest time or nullptr, if the heap is
+    // empty.
+    T* min() const { return root_; }
+
+    bool empty() const { return root_ == nullptr; }
+
+    // Returns true, if the element is in this heap. This only works for
+    // elements that are not part of a different heap.
+    bool contains(T const* t) const { return t->prev or t == root_; }
+
+    void insert(T* t)
+    {
+        assert(not contains(t));
+
+        t->prev = t->next = t->child = nullptr;
+
+        root_ = meld(root_, t);
+    }
+
+    void remove(T* t)
+    {
+        assert(contains(t));
+
+        if (t == root_) {
+            root_ = merge_pairs(t->child);
+        } else {
+            // Cut the subtree rooted at t out of its sibling list.
+            if (t->prev->child == t) {
+                t->prev->child = t->next;
+            } else {
+                t->prev->next = t->next;
+            }
+
+            if (t->next) {
+                t->next->prev = t->prev;
+            }
+
+            root_ = meld(root_, merge_pairs(t->child));
+        }
+
+        if (root_) {
+            root_->prev = nullptr;
+        }
+
+        t->prev = t->next = t->child = nullptr;
+    }
+
+    Pairing_heap() : root_{nullptr} {}
+};
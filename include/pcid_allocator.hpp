@@ -0,0 +1,106 @@
+/*
+ * Per-CPU PCID Allocator
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include "assert.hpp"
+#include "types.hpp"
+
+// Assigns PCIDs to address spaces on a single CPU.
+//
+// With PCIDs, the TLB keeps entries of several address spaces at the same
+// time and switching between them does not need a flush. There are far fewer
+// PCIDs than address spaces, though. Each CPU thus hands out PCIDs to the
+// address spaces it actually runs and recycles the least recently used PCID
+// once all of them are taken.
+//
+// Address spaces are identified by a tag that is never reused. The tag acts
+// as a generation number: a PCID that was last used by an address space that
+// is gone never matches again and is recycled like any other PCID. This way,
+// destroying an address space does not need to visit the allocators of all
+// CPUs.
+//
+// PCID 0 is never handed out and remains for the kernel page table.
+template <size_t NUM> class Pcid_allocator
+{
+    static_assert(NUM > 0 and NUM < 4096, "PCIDs are 12 bits wide and PCID 0 is reserved");
+
+    // The tag of the address space that owns PCID i + 1 or zero, if the PCID
+    // was never used.
+    uint64 tags_[NUM];
+
+    // The value of clock_ when PCID i + 1 was last handed out.
+    uint64 last_use_[NUM];
+
+    uint64 clock_;
+
+    static uint16 pcid(size_t slot) { return static_cast<uint16>(slot + 1); }
+
+public:
+    struct Assignment {
+        uint16 pcid;
+
+        // True, if the TLB may still contain entries for this PCID that
+        // belong to another address space. These need to be flushed before
+        // the address space can run.
+        bool needs_flush;
+    };
+
+    // Returns the PCID for the address space with the given tag.
+    //
+    // If the address space does not own a PCID on this CPU, it gets a PCID
+    // that was never used or the least recently used one.
+    Assignment assign(uint64 tag)
+    {
+        assert(tag != 0);
+
+        size_t victim{0};
+
+        clock_++;
+
+        for (size_t i{0}; i < NUM; i++) {
+            if (tags_[i] == tag) {
+                last_use_[i] = clock_;
+                return {pcid(i), false};
+            }
+
+            if (last_use_[i] < last_use_[victim]) {
+                victim = i;
+            }
+        }
+
+        tags_[victim] = tag;
+        last_use_[victim] = clock_;
+
+        return {pcid(victim), true};
+    }
+
+    // Returns the PCID the address space with the given tag owns on this CPU
+    // or 0, if it does not own one.
+    uint16 lookup(uint64 tag) const
+    {
+        assert(tag != 0);
+
+        for (size_t i{0}; i < NUM; i++) {
+            if (tags_[i] == tag) {
+                return pcid(i);
+            }
+        }
+
+        return 0;
+    }
+
+    Pcid_allocator() : tags_{}, last_use_{}, clock_{0} {}
+};
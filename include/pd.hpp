@@ -65,8 +65,15 @@ private:
         }
     }
 
+    CPULOCAL_ACCESSOR(pd, pcids);
+
 public:
     CPULOCAL_REMOTE_ACCESSOR(pd, current);
+
+    // The CR3 value of the current PD on this CPU. This is what VM exits
+    // need to restore.
+    CPULOCAL_ACCESSOR(pd, host_cr3);
+
     static No_destruct<Pd> kern;
 
     // The roottask is privileged and can map arbitrary physical memory that
@@ -112,18 +119,14 @@ public:
 
     HOT inline void make_current()
     {
-        mword pcid = did;
+        bool flush = false;
 
-        if (EXPECT_FALSE(stale_host_tlb.chk(Cpu::id())))
+        if (EXPECT_FALSE(stale_host_tlb.chk(Cpu::id()))) {
             stale_host_tlb.clr(Cpu::id());
+            flush = true;
 
-        else {
-
-            if (EXPECT_TRUE(current() == this))
-                return;
-
-            pcid |= static_cast<mword>(1ULL << 63);
-        }
+        } else if (EXPECT_TRUE(current() == this))
+            return;
 
         if (current()->del_rcu())
             Rcu::call(current());
@@ -137,7 +140,25 @@ public:
         // host page table is actually all the physical memory that
         // userspace can use, so we cannot use it as a page table here.
         Hpt& target_hpt{EXPECT_FALSE(this == &Pd::kern) ? Hpt::boot_hpt() : hpt};
-        target_hpt.make_current(Cpu::feature(Cpu::FEAT_PCID) ? pcid : 0);
+        bool const use_pcid{Cpu::feature(Cpu::FEAT_PCID)};
+        mword pcid = 0;
+
+        // Pd::kern keeps PCID 0. All other PDs get a PCID from the allocator
+        // of this CPU. If the PCID was recycled, it may still tag TLB entries
+        // of another PD, so we need to flush it.
+        if (EXPECT_TRUE(use_pcid and this != &Pd::kern)) {
+            auto const assignment{pcids().assign(pcid_tag)};
+
+            pcid = assignment.pcid;
+            flush |= assignment.needs_flush;
+        }
+
+        host_cr3() = target_hpt.root() | pcid;
+
+        if (EXPECT_TRUE(use_pcid and not flush))
+            pcid |= static_cast<mword>(1ULL << 63);
+
+        target_hpt.make_current(pcid);
     }
 
     // Access the current PD on a remote core.
@@ -166,14 +187,37 @@ public:
     Tlb_cleanup delegate(Pd* snd, mword snd_base, mword rcv_base, mword ord, mword attr, mword sub = 0,
                          char const* deltype = nullptr);
 
-    template <typename> void revoke(mword, mword, mword, bool);
+    template <typename> Tlb_cleanup revoke(mword, mword, mword, bool);
+
+    // Add the deferred TLB maintenance of a single item to a batch. A TLB
+    // shootdown that is requested while the batch already has one pending is
+    // folded into the pending one and counted as coalesced.
+    static void defer_cleanup(Tlb_cleanup& batch, Tlb_cleanup& item);
+
+    // Perform the TLB shootdown a batch has accumulated, if any, and free the
+    // page tables that became unused.
+    static void flush_cleanup(Tlb_cleanup& batch);
+
+    // Free a page that userspace may still access through stale TLB entries
+    // after the next TLB shootdown. The shootdown happens on the next exit
+    // from the kernel on this CPU. This is for code that may run in
+    // interrupt context, e.g. RCU callbacks, where we cannot wait for other
+    // CPUs.
+    static void free_page_after_flush(void* page);
+
+    // Perform the TLB shootdown for the pages of free_page_after_flush() and
+    // free them.
+    static void flush_deferred_cleanup();
 
     Xfer xfer_item(Pd*, Crd, Crd, Xfer);
+    Xfer xfer_item(Pd*, Crd, Crd, Xfer, Tlb_cleanup&);
     void xfer_items(Pd*, Crd, Crd, Xfer*, Xfer*, unsigned long);
 
     void xlt_crd(Pd*, Crd, Crd&);
     void del_crd(Pd*, Crd, Crd&, mword = 0, mword = 0);
+    void del_crd(Pd*, Crd, Crd&, Tlb_cleanup&, mword = 0, mword = 0);
     void rev_crd(Crd, bool);
+    void rev_crd(Crd, bool, Tlb_cleanup&);
 
     static inline void* operator new(size_t) { return cache.alloc(); }
 
@@ -0,0 +1,134 @@
+/*
+ * Priority-Indexed Ready Queue
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include "assert.hpp"
+#include "math.hpp"
+#include "types.hpp"
+
+// A set of circular queues, one per priority.
+//
+// Elements of type T need prev and next pointers that are accessible to this
+// class. An element can be in at most one queue at a time.
+//
+// Besides the queue heads, we keep a two-level bitmap of non-empty queues.
+// This way, finding the highest priority with a ready element takes two bit
+// scans instead of a walk over all priorities.
+template <typename T, size_t NUM_PRIO> class Ready_queue
+{
+    static constexpr size_t BITS_PER_WORD{sizeof(mword) * 8};
+    static constexpr size_t WORDS{align_up(NUM_PRIO, BITS_PER_WORD) / BITS_PER_WORD};
+
+    static_assert(WORDS <= BITS_PER_WORD, "Too many priorities for a two-level bitmap");
+
+    // Bit i is set, if words_[i] is non-zero.
+    mword summary_;
+
+    // Bit p % BITS_PER_WORD of word p / BITS_PER_WORD is set, if heads_[p]
+    // is not empty.
+    mword words_[WORDS];
+
+    T* heads_[NUM_PRIO];
+
+    void mark_ready(unsigned prio)
+    {
+        words_[prio / BITS_PER_WORD] |= 1UL << (prio % BITS_PER_WORD);
+        summary_ |= 1UL << (prio / BITS_PER_WORD);
+    }
+
+    void mark_empty(unsigned prio)
+    {
+        mword& word{words_[prio / BITS_PER_WORD]};
+
+        word &= ~(1UL << (prio % BITS_PER_WORD));
+
+        if (not word) {
+            summary_ &= ~(1UL << (prio / BITS_PER_WORD));
+        }
+    }
+
+public:
+    // Returns true, if no element is queued.
+    bool empty() const { return summary_ == 0; }
+
+    // Returns the highest priority with a queued element or 0, if all queues
+    // are empty.
+    unsigned top_prio() const
+    {
+        if (EXPECT_FALSE(empty())) {
+            return 0;
+        }
+
+        size_t const w{static_cast<size_t>(bit_scan_reverse(summary_))};
+
+        return static_cast<unsigned>(w * BITS_PER_WORD + static_cast<size_t>(bit_scan_reverse(words_[w])));
+    }
+
+    // Returns the first element of the given priority or nullptr.
+    T* head(unsigned prio) const
+    {
+        assert(prio < NUM_PRIO);
+        return heads_[prio];
+    }
+
+    // Returns the first element of the highest priority or nullptr.
+    T* top() const { return heads_[top_prio()]; }
+
+    // Append an element to the queue of the given priority. If front is true,
+    // the element becomes the head of this queue instead.
+    void enqueue(T* t, unsigned prio, bool front)
+    {
+        assert(prio < NUM_PRIO);
+
+        T*& head{heads_[prio]};
+
+        if (not head) {
+            head = t->prev = t->next = t;
+            mark_ready(prio);
+        } else {
+            t->next = head;
+            t->prev = head->prev;
+            t->next->prev = t->prev->next = t;
+
+            if (front) {
+                head = t;
+            }
+        }
+    }
+
+    // Remove an element from the queue of the given priority.
+    void dequeue(T* t, unsigned prio)
+    {
+        assert(prio < NUM_PRIO);
+        assert(t->prev and t->next);
+
+        T*& head{heads_[prio]};
+
+        if (head == t) {
+            head = t->next == t ? nullptr : t->next;
+        }
+
+        t->next->prev = t->prev;
+        t->prev->next = t->next;
+        t->prev = t->next = nullptr;
+
+        if (not head) {
+            mark_empty(prio);
+        }
+    }
+
+    Ready_queue() : summary_{0}, words_{}, heads_{} {}
+};
@@ -217,6 +217,9 @@ public:
     // Used to transfer the gs segment register to or from a CPU.
     // Don't confuse with "gs"-property derived from class Exc_regs!
     mword gs_base;
+    // The value of the HOST_CR3 field in the VMCS. The PCID of a PD can
+    // change between two VM exits, so this needs to be kept up-to-date.
+    mword vmcs_host_cr3;
 
     inline mword hazard() const { return hzd; }
 
@@ -22,11 +22,12 @@
 
 #pragma once
 
-#include "spinlock.hpp"
+#include "mpsc_queue.hpp"
 
 class Sc;
 
-struct Rq {
-    Spinlock lock;
-    Sc* queue;
-};
+// The queue of SCs that other CPUs have made ready on this CPU.
+//
+// Remote CPUs add SCs without taking a lock. The owning CPU moves them to
+// its ready queue when it handles the VEC_IPI_RRQ IPI.
+using Rq = Mpsc_queue<Sc>;
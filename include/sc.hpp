@@ -29,6 +29,8 @@ class Ec;
 class Sc : public Typed_kobject<Kobject::Type::SC>, public Refcount
 {
     friend class Queue<Sc>;
+    friend class Ready_queue<Sc, NUM_PRIORITIES>;
+    friend class Mpsc_queue<Sc>;
 
 public:
     Refptr<Ec> const ec;
@@ -45,8 +47,7 @@ private:
     static Slab_cache cache;
 
     CPULOCAL_REMOTE_ACCESSOR(sc, rq);
-    CPULOCAL_ACCESSOR(sc, list);
-    CPULOCAL_ACCESSOR(sc, prio_top);
+    CPULOCAL_ACCESSOR(sc, ready);
 
     void ready_enqueue(uint64, bool);
 
@@ -73,7 +74,6 @@ public:
 
     CPULOCAL_ACCESSOR(sc, current);
     CPULOCAL_ACCESSOR(sc, ctr_link);
-    CPULOCAL_ACCESSOR(sc, ctr_loop);
 
     static unsigned const default_prio = 1;
     static unsigned const default_quantum = 10000;
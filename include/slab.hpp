@@ -21,6 +21,7 @@
 #pragma once
 
 #include "buddy.hpp"
+#include "cpulocal.hpp"
 #include "initprio.hpp"
 
 class Slab;
@@ -32,11 +33,24 @@ private:
     Slab* curr;
     Slab* head;
 
+    // The index of this cache's magazine in the CPU-local slab_magazines
+    // array or NUM_SLAB_MAGAZINES, if this cache has no magazines.
+    unsigned const magazine;
+
+    static unsigned magazine_ctr;
+
+    CPULOCAL_ACCESSOR(slab, magazines);
+
     /*
      * Back end allocator
      */
     void grow();
 
+    void* alloc_locked();
+    void free_locked(void* ptr);
+
+    bool has_magazine() const { return magazine < NUM_SLAB_MAGAZINES and Cpulocal::is_initialized(); }
+
 public:
     unsigned long size; // Size of an element
     unsigned long buff; // Size of an element buffer (includes link field)
@@ -53,6 +67,12 @@ public:
      * Front end deallocator
      */
     void free(void* ptr);
+
+    /*
+     * Bulk interface for the per-CPU magazines
+     */
+    size_t alloc_bulk(void** objs, size_t n);
+    void free_bulk(void* const* objs, size_t n);
 };
 
 class Slab
@@ -0,0 +1,93 @@
+/*
+ * Per-CPU Object Cache for Slab and Page Allocators
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include "assert.hpp"
+#include "compiler.hpp"
+#include "types.hpp"
+
+// A magazine of free objects in front of a shared slab or page allocator.
+//
+// Allocations and frees are served from the magazine without any
+// synchronization, so each magazine must only ever be used by a single CPU.
+// When the magazine runs empty, it is refilled with a batch of objects from
+// the backend. When it runs full, a batch of objects is returned to the
+// backend. This way, the backend lock is taken at most once per batch.
+//
+// The BACKEND type needs to provide the following methods:
+//
+// - size_t alloc_bulk(void** objs, size_t n) fills objs with up to n objects
+//   and returns how many objects it could provide.
+// - void free_bulk(void* const* objs, size_t n) returns n objects.
+//
+// For an example of how to implement the backend, check the unit tests.
+template <size_t SIZE> class Slab_magazine
+{
+    static_assert(SIZE >= 2 and SIZE % 2 == 0, "Magazine size must be even");
+
+    // The number of objects we move from or to the backend at once. We keep
+    // half the magazine to avoid ping-ponging objects with the backend when
+    // alternating between allocations and frees at the boundary.
+    static constexpr size_t BATCH{SIZE / 2};
+
+    size_t count_;
+    void* objs_[SIZE];
+
+public:
+    // Returns the number of objects currently cached in the magazine.
+    size_t size() const { return count_; }
+
+    // Returns the maximum number of objects that can be cached.
+    static constexpr size_t max_size() { return SIZE; }
+
+    // Returns nullptr, if the magazine is empty and the backend cannot
+    // provide any more objects.
+    template <typename BACKEND> void* alloc(BACKEND& backend)
+    {
+        if (EXPECT_FALSE(count_ == 0)) {
+            count_ = backend.alloc_bulk(objs_, BATCH);
+
+            assert(count_ <= BATCH);
+
+            if (EXPECT_FALSE(count_ == 0)) {
+                return nullptr;
+            }
+        }
+
+        return objs_[--count_];
+    }
+
+    template <typename BACKEND> void free(BACKEND& backend, void* obj)
+    {
+        assert(obj != nullptr);
+
+        if (EXPECT_FALSE(count_ == SIZE)) {
+            backend.free_bulk(objs_ + SIZE - BATCH, BATCH);
+            count_ -= BATCH;
+        }
+
+        objs_[count_++] = obj;
+    }
+
+    // Return all cached objects to the backend.
+    template <typename BACKEND> void drain(BACKEND& backend)
+    {
+        backend.free_bulk(objs_, count_);
+        count_ = 0;
+    }
+
+    Slab_magazine() : count_{0} {}
+};
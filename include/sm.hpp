@@ -32,10 +32,27 @@ class Sm : public Typed_kobject<Kobject::Type::SM>,
            public Si
 {
 private:
+    // Without a shared counter, the number of available units. Otherwise,
+    // the number of wakeups for ECs that have not blocked yet.
     mword counter;
 
+    // The counter that is shared with userspace or nullptr.
+    //
+    // A positive value is the number of available units. A negative value
+    // is the number of blocked ECs. Userspace increments and decrements the
+    // counter without entering the kernel, as long as this does not wake up
+    // or block an EC. All other changes are made by up() and dn() under the
+    // lock. This way, only contended semaphores need system calls.
+    long* shared{nullptr};
+
+    // The PD the shared counter is mapped into and its address there.
+    Pd* shared_pd{nullptr};
+    mword shared_addr{0};
+
     static Slab_cache cache;
 
+    static void pre_free(Rcu_elem*);
+
     static void free(Rcu_elem* a)
     {
         Sm* sm = static_cast<Sm*>(a);
@@ -69,17 +86,22 @@ public:
     }
 
     Sm(Pd*, mword, mword = 0, Sm* = nullptr, mword = 0);
-    ~Sm()
-    {
-        while (!counter)
-            up(Ec::sys_finish<Sys_regs::BAD_CAP, true>);
-    }
+
+    // Create a semaphore with a counter that is shared with userspace.
+    Sm(Pd*, mword, long, mword);
+
+    ~Sm();
+
+    inline bool has_shared_counter() const { return shared; }
 
     inline void dn(bool zero, uint64 t, Ec* ec = Ec::current(), bool block = true)
     {
         {
             Lock_guard<Spinlock> guard(lock);
 
+            if (shared and Atomic::sub(*shared, 1L) >= 0)
+                return;
+
             if (counter) {
                 counter = zero ? 0 : counter - 1;
 
@@ -91,6 +113,9 @@ public:
             }
 
             if (!ec->add_ref()) {
+                if (shared)
+                    Atomic::add(*shared, 1L);
+
                 Sc::schedule(block);
                 return;
             }
@@ -111,6 +136,7 @@ public:
     inline void up(void (*c)() = nullptr, Sm* si = nullptr)
     {
         Ec* ec = nullptr;
+        bool counted = false;
 
         do {
             if (ec)
@@ -119,6 +145,13 @@ public:
             {
                 Lock_guard<Spinlock> guard(lock);
 
+                if (shared and not counted) {
+                    counted = true;
+
+                    if (Atomic::add(*shared, 1L) > 0)
+                        return;
+                }
+
                 if (!Queue<Ec>::dequeue(ec = Queue<Ec>::head())) {
 
                     if (si) {
@@ -140,6 +173,25 @@ public:
         } while (EXPECT_FALSE(ec->del_rcu()));
     }
 
+    // Dequeue ready signals and store their value and count in consecutive
+    // words of pairs until max_pairs signals are collected. Returns the
+    // number of signals.
+    inline mword drain(mword* pairs, mword max_pairs)
+    {
+        Lock_guard<Spinlock> guard(lock);
+
+        mword n{0};
+
+        for (Si* si; n < max_pairs and counter and Queue<Si>::dequeue(si = Queue<Si>::head()); n++) {
+            counter--;
+
+            pairs[2 * n] = si->value;
+            pairs[2 * n + 1] = static_cast<Sm*>(si)->reset(true);
+        }
+
+        return n;
+    }
+
     inline void timeout(Ec* ec)
     {
         {
@@ -147,6 +199,10 @@ public:
 
             if (!Queue<Ec>::dequeue(ec))
                 return;
+
+            // The EC does not wait anymore.
+            if (shared)
+                Atomic::add(*shared, 1L);
         }
 
         ec->release(Ec::sys_finish<Sys_regs::COM_TIM>);
@@ -31,6 +31,9 @@
 
 class Space_mem
 {
+private:
+    CPULOCAL_ACCESSOR(space_mem, shootdown_ctr);
+
 public:
     Hpt hpt;
 
@@ -39,8 +42,17 @@ public:
     Ept ept;
     Hpt npt;
 
+    // Serializes all updates of ept and npt. Promoting page tables to
+    // superpages replaces and frees page tables that cover more than the
+    // delegated region, so it must not race with other updates of them.
+    Spinlock guest_lock;
+
     mword did;
 
+    // Identifies this address space to the per-CPU PCID allocators. Unlike
+    // did, it is never reused.
+    uint64 const pcid_tag;
+
     // A bitmask of CPUs that have at least one EC in this PD.
     Cpuset cpus;
 
@@ -52,15 +64,34 @@ public:
     // of this Space_mem's ept or npt cached in their TLB.
     Cpuset stale_guest_tlb;
 
+    // The page table whose kernel mappings hpt shares or nullptr.
+    Hpt* const kernel_src{nullptr};
+
     static unsigned did_ctr;
+    static uint64 pcid_tag_ctr;
 
     // Constructor for the initial kernel memory space. The HPT doubles as
     // database, which memory is safe to give to userspace.
-    Space_mem() : hpt(Hpt::make_golden_hpt()), did(Atomic::add(did_ctr, 1U)) {}
+    Space_mem()
+        : hpt(Hpt::make_golden_hpt()), did(Atomic::add(did_ctr, 1U)),
+          pcid_tag(Atomic::add(pcid_tag_ctr, uint64{1}))
+    {
+    }
 
     // Constructor for normal memory spaces. The hpt parameter is the source
     // page table to populate kernel mappings.
-    explicit Space_mem(Hpt& src) : hpt(src.deep_copy(LINK_ADDR, SPC_LOCAL)), did(Atomic::add(did_ctr, 1U)) {}
+    explicit Space_mem(Hpt& src)
+        : did(Atomic::add(did_ctr, 1U)), pcid_tag(Atomic::add(pcid_tag_ctr, uint64{1})), kernel_src(&src)
+    {
+        hpt.share_kernel(src);
+    }
+
+    ~Space_mem()
+    {
+        if (kernel_src) {
+            hpt.unshare_kernel(*kernel_src);
+        }
+    }
 
     NONNULL inline bool lookup(mword virt, Paddr* phys) { return hpt.lookup_phys(virt, phys); }
 
@@ -69,6 +100,13 @@ public:
         hpt.update({virt, phys, attr, static_cast<Hpt::ord_t>(o + PAGE_BITS)});
     }
 
+    // Remove a mapping that insert() created. The caller needs to flush the
+    // TLBs of all CPUs in cpus before the memory can be reused.
+    WARN_UNUSED_RESULT inline Tlb_cleanup remove(mword virt, unsigned o)
+    {
+        return hpt.update({virt, 0, 0, static_cast<Hpt::ord_t>(o + PAGE_BITS)});
+    }
+
     inline Paddr replace(mword v, Paddr p) { return hpt.replace(v, p); }
 
     void insert_root(uint64, uint64, mword = 0x7);
@@ -89,6 +127,24 @@ public:
     // Revoke specific rights from a region of memory.
     Tlb_cleanup revoke(mword vaddr, mword ord, mword attr);
 
+    // Returns true, if the CPU maintains dirty bits in guest page tables.
+    static bool has_guest_dirty_bits();
+
+    // Returns the end of the guest-physical address space.
+    mword guest_end() const;
+
+    // Find and clear dirty guest-physical pages.
+    //
+    // Bit i in bitmap is set, if the guest wrote to the page at gpa + i *
+    // PAGE_SIZE since the last call. The bitmap needs to hold at least
+    // pages bits.
+    Tlb_cleanup harvest_dirty(mword gpa, mword pages, mword* bitmap);
+
+    // Invalidate stale TLB entries on all CPUs.
+    //
+    // All CPUs that need to flush are interrupted at once and we only wait
+    // for their acknowledgements afterwards. The latency of a shootdown is
+    // thus bounded by the slowest CPU instead of the sum of all CPUs.
     static void shootdown();
 
     void init(unsigned);
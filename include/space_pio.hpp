@@ -28,26 +28,48 @@ class Space_mem;
 class Space_pio : public Space
 {
 private:
+    // The host and guest I/O permission bitmaps or zero, if they are not
+    // allocated yet. Until then, the shared bitmap that denies access to
+    // all ports stands in for them.
     Paddr hbmp, gbmp;
 
+    // Serializes the allocation of hbmp and gbmp. A bitmap is only published
+    // once it is in place, so nobody modifies a host bitmap that the CPU
+    // does not use yet.
+    Spinlock bmp_lock;
+
+    Space_mem* const mem;
+
+    // Return the bitmap that denies access to all ports.
+    static Paddr deny_all_bmp();
+
+    // Return the bitmap to modify for the given subspace. Returns true in
+    // tlb_flush, if the host bitmap was just mapped in place of the shared
+    // one.
+    Paddr bmp(bool host, bool& tlb_flush);
+
     static inline mword idx_to_virt(mword idx)
     {
         return SPC_LOCAL_IOP + (idx / 8 / sizeof(mword)) * sizeof(mword);
     }
 
-    static inline mword idx_to_mask(mword idx) { return 1UL << (idx % (8 * sizeof(mword))); }
-
-    void update(bool, mword, mword);
+    // Allow or deny access to count ports starting at idx in the given bitmap.
+    static void update(Paddr, mword, mword, bool);
 
 public:
     /// Construct a new Port I/O space.
     ///
-    /// During the construction, this function will modify the page table to setup the IO Permission
-    /// Bitmap. See `Tss::build`.
+    /// During the construction, this function will modify the page table to map the shared IO
+    /// Permission Bitmap that denies access to all ports. The PD gets its own bitmaps with the first
+    /// port delegation. See `Tss::build`.
     Space_pio(Space_mem* mem);
 
     ~Space_pio();
 
+    /// Return the physical address of the bitmap word for the given port.
+    ///
+    /// Allocates the bitmap, if necessary. The guest bitmap is referenced by the VMCS/VMCB of each
+    /// vCPU, so it needs to exist before the first vCPU of a PD is created.
     Paddr walk(bool = false, mword = 0);
 
     Tlb_cleanup update(Mdb*, mword = 0);
@@ -32,6 +32,12 @@ extern "C" NONNULL void* memset(void* d, int c, size_t n);
 
 #endif // __STDC_HOSTED__
 
+/// Zero memory using 8-byte stores. d and n must be 8-byte aligned.
+void* memzero_stosq(void* d, size_t n);
+
+/// Zero memory bypassing the caches. d and n must be 32-byte aligned.
+void* memzero_nt(void* d, size_t n);
+
 /// Check whether the first n bytes in two strings match.
 bool strnmatch(char const* s1, char const* s2, size_t n);
 
@@ -50,6 +50,35 @@ inline void* impl_memset(void* d, int c, size_t n)
     return d;
 }
 
+// Zero n bytes at d using 8-byte stores. Both d and n must be 8-byte aligned.
+inline void* impl_memzero_stosq(void* d, size_t n)
+{
+    void* dummy;
+    size_t qwords = n / 8;
+    asm volatile("rep; stosq" : "=D"(dummy), "+c"(qwords) : "0"(d), "a"(0UL) : "memory");
+    return d;
+}
+
+// Zero n bytes at d using non-temporal stores that bypass the caches. This is
+// useful for memory that is not going to be accessed soon. Both d and n must
+// be 32-byte aligned.
+inline void* impl_memzero_nt(void* d, size_t n)
+{
+    for (char *p = static_cast<char*>(d), *e = p + n; p < e; p += 32) {
+        asm volatile("movnti %1, 0(%0);"
+                     "movnti %1, 8(%0);"
+                     "movnti %1, 16(%0);"
+                     "movnti %1, 24(%0);"
+                     :
+                     : "r"(p), "r"(0UL)
+                     : "memory");
+    }
+
+    // Non-temporal stores are weakly ordered.
+    asm volatile("sfence" : : : "memory");
+    return d;
+}
+
 inline bool impl_strnmatch(char const* s1, char const* s2, size_t n)
 {
     while (n && *s1 == *s2)
@@ -116,6 +116,11 @@ public:
     inline mword cnt() const { return ARG_3; }
 
     inline unsigned long sm() const { return ARG_4; }
+
+    // Keep the counter in a page that is mapped at user_page().
+    inline bool shared_counter() const { return flags() & 0x1; }
+
+    inline mword user_page() const { return ARG_5; }
 };
 
 class Sys_revoke : public Sys_regs
@@ -198,10 +203,14 @@ public:
     enum ctrl_op
     {
         RECALL,
+        RECALL_MANY,
     };
 
     inline unsigned long ec() const { return ARG_1 >> ARG1_SEL_SHIFT; }
 
+    // Bit i selects the EC at selector ec() + i for RECALL_MANY.
+    inline mword ec_mask() const { return ARG_2; }
+
     inline unsigned op() const { return flags() & 0x3; }
 };
 
@@ -241,7 +250,21 @@ public:
 
     inline unsigned zc() const { return flags() & 0x2; }
 
+    // Return all ready signals of the semaphore via the UTCB.
+    inline bool drain() const { return flags() & 0x4; }
+
     inline uint64 time() const { return static_cast<uint64>(ARG_2) << 32 | ARG_3; }
+
+    // The signal that the semaphore handed to the EC during the down
+    // operation, if the count is not zero.
+    inline mword si_value() const { return ARG_2; }
+    inline mword si_count() const { return ARG_3; }
+
+    inline void set_drained(mword n)
+    {
+        ARG_2 = n;
+        ARG_3 = 0;
+    }
 };
 
 class Sys_assign_pci : public Sys_regs
@@ -288,6 +311,8 @@ public:
     {
         SUSPEND = 0,
         UPDATE_MICROCODE = 1,
+        READ_COUNTER = 2,
+        TRACE = 3,
     };
 
     inline ctrl_op op() const { return static_cast<ctrl_op>(flags() & 0x3); }
@@ -320,3 +345,62 @@ public:
     inline unsigned size() const { return static_cast<unsigned>(ARG_1) >> ARG1_SEL_SHIFT; }
     inline mword update_address() const { return static_cast<mword>(ARG_2); }
 };
+
+class Sys_machine_ctrl_read_counter : public Sys_machine_ctrl
+{
+public:
+    inline unsigned long counter() const { return ARG_1 >> ARG1_SEL_SHIFT; }
+    inline unsigned cpu() const { return static_cast<unsigned>(ARG_2); }
+
+    inline void set_value(uint64 val) { ARG_2 = static_cast<mword>(val); }
+};
+
+class Sys_machine_ctrl_trace : public Sys_machine_ctrl
+{
+public:
+    inline unsigned mask() const { return static_cast<unsigned>(ARG_1 >> ARG1_SEL_SHIFT); }
+    inline unsigned cpu() const { return static_cast<unsigned>(ARG_2); }
+    inline Crd crd() const { return Crd(ARG_3); }
+
+    inline void set_old_mask(unsigned mask) { ARG_2 = mask; }
+};
+
+class Sys_dirty_log : public Sys_regs
+{
+public:
+    inline unsigned long pd() const { return ARG_1 >> ARG1_SEL_SHIFT; }
+
+    inline mword gpa() const { return ARG_2; }
+
+    inline mword pages() const { return ARG_3; }
+};
+
+class Sys_multicall : public Sys_regs
+{
+public:
+    // Each operation in a multicall occupies this many words in the UTCB
+    // data area. They hold ARG1 to ARG5 of the equivalent hypercall.
+    static constexpr size_t OP_WORDS{5};
+
+    inline unsigned long num_ops() const { return ARG_1 >> ARG1_SEL_SHIFT; }
+
+    inline void set_num_done(unsigned long num) { ARG_2 = num; }
+
+    inline void load_op(mword const* op)
+    {
+        ARG_1 = op[0];
+        ARG_2 = op[1];
+        ARG_3 = op[2];
+        ARG_4 = op[3];
+        ARG_5 = op[4];
+    }
+
+    inline void store_op(mword* op) const
+    {
+        op[0] = ARG_1;
+        op[1] = ARG_2;
+        op[2] = ARG_3;
+        op[3] = ARG_4;
+        op[4] = ARG_5;
+    }
+};
@@ -23,16 +23,18 @@
 
 class Timeout
 {
+    friend class Pairing_heap<Timeout>;
+
 protected:
-    Timeout *prev, *next;
+    Timeout *prev, *next, *child;
     uint64 time;
 
     virtual void trigger() = 0;
 
 public:
-    CPULOCAL_ACCESSOR(timeout, list);
+    CPULOCAL_ACCESSOR(timeout, heap);
 
-    inline Timeout() : prev(nullptr), next(nullptr), time(0) {}
+    inline Timeout() : prev(nullptr), next(nullptr), child(nullptr), time(0) {}
 
     ~Timeout()
     {
@@ -40,7 +42,7 @@ public:
             dequeue();
     }
 
-    inline bool active() const { return prev || list() == this; }
+    inline bool active() const { return heap().contains(this); }
 
     void enqueue(uint64);
     uint64 dequeue();
@@ -26,21 +26,38 @@
 // Deferred cleanup of page table structures and TLB flush tracking.
 //
 // This class does not implement the TLB flushing logic itself as this is
-// specific to the page table in question.
-class Tlb_cleanup
+// specific to the page table in question. Page table pages that are removed
+// from a page table are kept on a list until the initiator of the page table
+// modification has flushed the TLBs and releases them via free_pages_now().
+//
+// PAGE_LINK threads the list through the pages and frees them. See
+// Page_link_policy.
+template <typename PAGE_LINK> class Generic_tlb_cleanup
 {
+    using this_t = Generic_tlb_cleanup<PAGE_LINK>;
+
     bool tlb_flush_{false};
 
+    // The list of pages to be freed after the TLB flush. The list is
+    // threaded through PAGE_LINK instead of the pages, because they
+    // may still be read by page table walkers.
+    mword free_head_{0};
+    mword free_tail_{0};
+
 public:
     using pointer = mword*;
 
     // Returns true, if a TLB flush is scheduled.
     WARN_UNUSED_RESULT bool need_tlb_flush() const { return tlb_flush_; }
 
+    // Returns true, if there are pages waiting to be freed.
+    WARN_UNUSED_RESULT bool has_pages() const { return free_head_ != 0; }
+
     // Discard a scheduled TLB flush.
     //
     // This should be done with care as wrong usage will end up in TLB
-    // invalidation bugs.
+    // invalidation bugs. This must also be called after the TLB flush was
+    // performed to allow freeing pages.
     void ignore_tlb_flush() { tlb_flush_ = false; }
 
     // Schedule a TLB flush.
@@ -51,7 +68,12 @@ public:
     {
         assert(not tlb_flush_);
 
-        // Not implemented yet.
+        for (mword page{free_head_}, next; page != 0; page = next) {
+            next = PAGE_LINK::get_link(page);
+            PAGE_LINK::free_page(page);
+        }
+
+        free_head_ = free_tail_ = 0;
     }
 
     // Mark a page as to-be-freed after the next TLB flush.
@@ -60,16 +82,22 @@ public:
     // actually happens.
     void free_later(pointer page)
     {
+        mword const addr{reinterpret_cast<mword>(page)};
+
         tlb_flush_ = true;
 
-        // This is not correct, because we need to defer freeing this page
-        // until the TLB flush has happened. As the broken behavior was
-        // already in the kernel, continue to live in the danger zone until
-        // we fix this issue for good.
-        Buddy::allocator.free(reinterpret_cast<mword>(page));
+        PAGE_LINK::set_link(addr, 0);
+
+        if (free_tail_ != 0) {
+            PAGE_LINK::set_link(free_tail_, addr);
+        } else {
+            free_head_ = addr;
+        }
+
+        free_tail_ = addr;
     }
 
-    // Merge two Tlb_cleanup objects.
+    // Merge two cleanup objects.
     //
     // This operation merges all deferred activity from the passed parameter
     // into the current instance. The parameter will become "empty" with no
@@ -78,32 +106,59 @@ public:
     {
         tlb_flush_ |= rhs.tlb_flush_;
         rhs.ignore_tlb_flush();
+
+        if (rhs.free_head_ == 0) {
+            return;
+        }
+
+        if (free_tail_ != 0) {
+            PAGE_LINK::set_link(free_tail_, rhs.free_head_);
+        } else {
+            free_head_ = rhs.free_head_;
+        }
+
+        free_tail_ = rhs.free_tail_;
+        rhs.free_head_ = rhs.free_tail_ = 0;
     }
 
-    Tlb_cleanup& operator=(Tlb_cleanup&& rhs)
+    this_t& operator=(this_t&& rhs)
     {
-        assert(not tlb_flush_);
+        assert(not tlb_flush_ and not has_pages());
 
         merge(rhs);
         return *this;
     }
 
-    Tlb_cleanup(Tlb_cleanup&& rhs) { merge(rhs); }
+    Generic_tlb_cleanup(this_t&& rhs) { merge(rhs); }
 
-    Tlb_cleanup& operator=(Tlb_cleanup const& rhs) = delete;
-    Tlb_cleanup(Tlb_cleanup const& rhs) = delete;
+    this_t& operator=(this_t const& rhs) = delete;
+    Generic_tlb_cleanup(this_t const& rhs) = delete;
 
-    Tlb_cleanup() = default;
-    explicit Tlb_cleanup(bool tlb_flush) : tlb_flush_{tlb_flush} {}
+    Generic_tlb_cleanup() = default;
+    explicit Generic_tlb_cleanup(bool tlb_flush) : tlb_flush_{tlb_flush} {}
 
     // A named convenience constructor for readable code.
-    static Tlb_cleanup tlb_flush(bool tlb_flush) { return Tlb_cleanup{tlb_flush}; }
+    static this_t tlb_flush(bool tlb_flush) { return this_t{tlb_flush}; }
 
-    ~Tlb_cleanup()
+    ~Generic_tlb_cleanup()
     {
-        // Once we fully implement this class, at destruction time there
-        // should be no TLB flush pending and all pages can be freed.
-        //
-        // assert (not tlb_flush_);
+        // Pages can only be reclaimed once the TLB flush has happened or
+        // was explicitly discarded. Otherwise, they would leak.
+        assert(not(tlb_flush_ and has_pages()));
+
+        if (not tlb_flush_) {
+            free_pages_now();
+        }
     }
 };
+
+// Keeps the list of pages of a Tlb_cleanup in the buddy allocator metadata.
+class Page_link_policy
+{
+public:
+    static void set_link(mword page, mword next) { Buddy::allocator.set_link(page, next); }
+    static mword get_link(mword page) { return Buddy::allocator.get_link(page); }
+    static void free_page(mword page) { Buddy::allocator.free(page); }
+};
+
+using Tlb_cleanup = Generic_tlb_cleanup<Page_link_policy>;
@@ -0,0 +1,76 @@
+/*
+ * Binary Event Tracing
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include "atomic.hpp"
+#include "config.hpp"
+#include "cpu.hpp"
+#include "memory.hpp"
+#include "trace_ring.hpp"
+#include "x86.hpp"
+
+// Binary tracing into per-CPU ring buffers.
+//
+// Unlike trace(), which formats a message and prints it synchronously on the
+// console, recording an event only costs a few stores into a CPU-local
+// buffer. Events are grouped by the TRACE_* categories in stdio.hpp and can
+// be enabled at runtime via machine_ctrl_trace. Privileged userspace maps the
+// rings read-only and decodes them with tools/trace-decode.py.
+class Trace
+{
+public:
+    using Ring = Trace_ring<TRACE_RING_PAGES * PAGE_SIZE>;
+
+    // Event IDs. These are part of the trace format and need to match
+    // tools/trace-decode.py. Never reuse or renumber them.
+    enum Event : uint32
+    {
+        SC_ENQUEUE = 1,   // SC, priority, remaining budget
+        SC_DEQUEUE = 2,   // SC, priority, remaining budget
+        SYSCALL = 3,      // EC, ARG1, ARG2, ARG3
+        DELEGATE_MEM = 4, // Source PD, destination PD, source base, destination base, order
+        DELEGATE_PIO = 5, // Source PD, destination PD, base, order
+        DELEGATE_OBJ = 6, // Source PD, destination PD, source base, destination base, order
+    };
+
+private:
+    // The TRACE_* categories that are currently recorded.
+    static unsigned mask;
+
+    static Ring rings[NUM_CPU];
+
+    static Ring& ring() { return rings[Cpu::id()]; }
+
+public:
+    // Record an event of the given category, if the category is enabled.
+    template <typename... ARGS> static inline void record(unsigned type, Event event, ARGS... args)
+    {
+        if (EXPECT_FALSE(Atomic::load(mask) & type)) {
+            ring().record(rdtsc(), event, args...);
+        }
+    }
+
+    // Change the set of recorded categories. Returns the previous set.
+    static unsigned set_mask(unsigned new_mask);
+
+    // Returns the physical address of the trace ring of the given CPU.
+    static Paddr ring_phys(unsigned cpu);
+
+    // The size of a single trace ring as a page order.
+    static constexpr unsigned RING_ORDER{__builtin_ctz(TRACE_RING_PAGES)};
+
+    static_assert(TRACE_RING_PAGES == 1U << RING_ORDER, "Trace ring size must be a power of two pages");
+};
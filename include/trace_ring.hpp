@@ -0,0 +1,133 @@
+/*
+ * Binary Trace Ring Buffer
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include "barrier.hpp"
+#include "types.hpp"
+
+// A single trace event.
+//
+// The layout of this structure is visible to userspace and needs to match
+// tools/trace-decode.py.
+struct Trace_record {
+    static constexpr size_t MAX_ARGS{5};
+
+    // The position of this record in the stream of all records plus one. The
+    // value is zero while the record is being written. Readers compare this
+    // value before and after copying a record to detect concurrent updates.
+    uint64 seq;
+
+    uint64 tsc;
+    uint32 event;
+    uint32 num_args;
+    uint64 args[MAX_ARGS];
+};
+
+static_assert(sizeof(Trace_record) == 64, "Trace records should be exactly one cache line");
+
+// A ring buffer of trace records that occupies SIZE bytes.
+//
+// The ring has a single writer, which is the CPU that owns it. It never
+// blocks and overwrites the oldest records once the ring is full. Readers
+// access the ring concurrently via a read-only mapping. They find the newest
+// record via the head counter in the header and use the sequence numbers in
+// the records to detect records that were overwritten while reading.
+//
+// The ring has no constructor so it can live in .bss. Call init() before
+// the first record() call.
+template <size_t SIZE> class Trace_ring
+{
+public:
+    // "HTRACE01" in little-endian byte order.
+    static constexpr uint64 MAGIC{0x3130454341525448};
+
+    static constexpr size_t NUM_RECORDS{SIZE / sizeof(Trace_record) - 1};
+
+    static_assert(SIZE % sizeof(Trace_record) == 0 and NUM_RECORDS > 0, "Bad trace ring size");
+
+    // The header occupies the space of the first record.
+    struct Header {
+        uint64 magic;
+
+        // The number of records written so far. The newest record has index
+        // (head - 1) % num_records.
+        uint64 head;
+
+        uint32 record_size;
+        uint32 num_records;
+        uint64 reserved[5];
+    };
+
+    static_assert(sizeof(Header) == sizeof(Trace_record), "Header should fill the first record slot");
+
+private:
+    Header header_;
+    Trace_record records_[NUM_RECORDS];
+
+    static uint64 to_word(uint64 v) { return v; }
+    template <typename T> static uint64 to_word(T* p) { return reinterpret_cast<uint64>(p); }
+    template <typename T> static uint64 to_word(T v) { return static_cast<uint64>(v); }
+
+public:
+    void init()
+    {
+        header_.head = 0;
+        header_.record_size = sizeof(Trace_record);
+        header_.num_records = NUM_RECORDS;
+
+        for (auto& r : records_) {
+            r.seq = 0;
+        }
+
+        barrier();
+        header_.magic = MAGIC;
+    }
+
+    bool initialized() const { return header_.magic == MAGIC; }
+
+    Header const& header() const { return header_; }
+
+    Trace_record const& at(uint64 idx) const { return records_[idx % NUM_RECORDS]; }
+
+    // Append a record. Arguments can be integers or pointers.
+    template <typename... ARGS> void record(uint64 tsc, uint32 event, ARGS... args)
+    {
+        static_assert(sizeof...(ARGS) <= Trace_record::MAX_ARGS, "Too many trace arguments");
+
+        uint64 const idx{header_.head};
+        Trace_record& r{records_[idx % NUM_RECORDS]};
+
+        // Readers need to see that the record is being changed before they
+        // see any of the new content. On x86, stores are not reordered with
+        // other stores, so we only need to keep the compiler in check.
+        r.seq = 0;
+        barrier();
+
+        r.tsc = tsc;
+        r.event = event;
+        r.num_args = sizeof...(ARGS);
+
+        uint64 const words[Trace_record::MAX_ARGS]{to_word(args)...};
+
+        for (size_t i{0}; i < Trace_record::MAX_ARGS; i++) {
+            r.args[i] = words[i];
+        }
+
+        barrier();
+        r.seq = idx + 1;
+        header_.head = idx + 1;
+    }
+};
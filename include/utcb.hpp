@@ -135,6 +135,9 @@ public:
 
     inline mword& mr(mword i) { return (&data_begin)[i]; }
 
+    // The number of message words that fit into the UTCB.
+    static inline mword num_mr() { return words; }
+
     NONNULL
     inline void save(Utcb* dst)
     {
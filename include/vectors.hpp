@@ -37,3 +37,5 @@
 #define VEC_IPI_RKE (VEC_IPI + 1)
 #define VEC_IPI_IDL (VEC_IPI + 2)
 #define VEC_IPI_PRK (VEC_IPI + 3)
+#define VEC_IPI_XCL (VEC_IPI + 4)
+#define VEC_IPI_BDR (VEC_IPI + 5)
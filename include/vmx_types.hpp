@@ -35,7 +35,7 @@ union vmx_basic {
 union vmx_ept_vpid {
     uint64 val;
     struct {
-        uint32 : 16, super : 2, : 2, invept : 1, : 11;
+        uint32 : 16, super : 2, : 2, invept : 1, ad : 1, : 10;
         uint32 invvpid : 1;
     };
 };
@@ -0,0 +1,47 @@
+/*
+ * Cross-CPU Portal Call Requests
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include "mpsc_queue.hpp"
+#include "types.hpp"
+
+class Ec;
+
+// A portal call to a handler EC on another CPU.
+//
+// Each EC embeds one request, because an EC can only wait for a single call
+// at a time. While the call is in flight, the request holds a reference to
+// both the caller and the handler.
+struct Xcall {
+    Xcall* next{nullptr};
+
+    Ec* caller{nullptr};
+    Ec* handler{nullptr};
+
+    // The portal ID and entry point. We copy them out of the portal, because
+    // the portal may be destroyed while the call is in flight.
+    mword id{0};
+    mword ip{0};
+
+    // True, until the handler has replied.
+    bool waiting{false};
+};
+
+// The mailbox of cross-CPU portal calls that other CPUs have sent to this CPU.
+//
+// Remote CPUs add requests without taking a lock. The owning CPU takes them out
+// when it handles the VEC_IPI_XCL IPI.
+using Xcall_queue = Mpsc_queue<Xcall>;
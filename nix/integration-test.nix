@@ -17,6 +17,10 @@ stdenv.mkDerivation {
     echo "# Testing legacy direct kernel boot."
     qemu-boot ${hedron}/share/hedron/hypervisor.elf32 | tee output.log
 
+    # Many CPUs exercise the parallel TLB shootdown and IPI paths.
+    echo "# Testing legacy direct kernel boot with many CPUs."
+    qemu-boot ${hedron}/share/hedron/hypervisor.elf32 --cpus 16 | tee -a output.log
+
     tools/gen_usb.sh ${grub_image} ${hedron}/share/hedron/hypervisor.elf32 tools/grub.cfg.tmpl
 
     # We boot our disk images with different amounts of RAM to exercise relocation.
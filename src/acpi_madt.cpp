@@ -31,6 +31,7 @@
 void Acpi_table_madt::parse() const
 {
     parse_entry(Acpi_apic::LAPIC, &parse_lapic);
+    parse_entry(Acpi_apic::LX2APIC, &parse_lx2apic);
     parse_entry(Acpi_apic::IOAPIC, &parse_ioapic);
     parse_entry(Acpi_apic::INTR, &parse_intr);
 
@@ -56,6 +57,15 @@ void Acpi_table_madt::parse_lapic(Acpi_apic const* ptr)
     }
 }
 
+void Acpi_table_madt::parse_lx2apic(Acpi_apic const* ptr)
+{
+    Acpi_lx2apic const* p = static_cast<Acpi_lx2apic const*>(ptr);
+
+    // We address CPUs by 8-bit APIC IDs only.
+    if (p->flags & 1 && p->x2apic_id > 0xff)
+        wide_apic_ids = true;
+}
+
 void Acpi_table_madt::parse_ioapic(Acpi_apic const* ptr)
 {
     Acpi_ioapic const* p = static_cast<Acpi_ioapic const*>(ptr);
@@ -45,6 +45,7 @@ void Bootstrap::bootstrap()
 
     if (is_initial_boot) {
         create_idle_ec();
+        Ec::create_xcall_proxy();
     }
 
     wait_for_all_cpus();
@@ -20,14 +20,22 @@
 
 #include "buddy.hpp"
 #include "assert.hpp"
+#include "counter.hpp"
+#include "cpu.hpp"
+#include "hip.hpp"
 #include "initprio.hpp"
+#include "lapic.hpp"
 #include "lock_guard.hpp"
 #include "math.hpp"
 #include "stdio.hpp"
 #include "string.hpp"
+#include "vectors.hpp"
 
 extern char _mempool_l, _mempool_f, _mempool_e;
 
+static_assert(sizeof(Per_cpu::buddy_page_cache) / sizeof(*Per_cpu::buddy_page_cache) == Buddy::NUM_CACHED_ORDERS,
+              "Need one per-CPU page cache per cached order");
+
 /*
  * Buddy Allocator
  */
@@ -70,27 +78,42 @@ Buddy::Buddy(mword virt, mword f_addr, size_t size)
 
 void Buddy::fill(void* dst, Fill fill_mem, size_t size)
 {
-    if (fill_mem != NOFILL) {
-        memset(dst, fill_mem == FILL_0 ? 0 : -1, size);
+    switch (fill_mem) {
+    case NOFILL:
+        break;
+    case FILL_0:
+        // With enhanced REP STOSB, byte stores are as fast as anything else.
+        // Without it, 8-byte stores get considerably better throughput.
+        if (Cpulocal::is_initialized() and not Cpu::feature(Cpu::FEAT_ERMS) and
+            (reinterpret_cast<mword>(dst) | size) % sizeof(mword) == 0) {
+            memzero_stosq(dst, size);
+        } else {
+            memset(dst, 0, size);
+        }
+        break;
+    case FILL_1:
+        memset(dst, -1, size);
+        break;
     }
 }
 
-/*
- * Allocate physically contiguous memory region.
- * @param ord       Block order (2^ord pages)
- * @param fill      Initialization mode of allocated memory
- * @return          Pointer to linear memory region
- */
-void* Buddy::alloc(unsigned short ord, Fill fill_mem)
+void Buddy::count_lock()
 {
-    Lock_guard<Spinlock> guard(lock);
+    // The allocator is used before CPU-local memory is set up.
+    if (Cpulocal::is_initialized()) {
+        Counter::buddy_global()++;
+    }
+}
 
+void* Buddy::alloc_locked(unsigned short ord)
+{
     for (unsigned short j = ord; j < order; j++) {
 
         if (head[j].next == head + j)
             continue;
 
         Block* block = head[j].next;
+        free_pages -= 1ul << ord;
         block->prev->next = block->next;
         block->next->prev = block->prev;
         block->ord = ord;
@@ -109,34 +132,17 @@ void* Buddy::alloc(unsigned short ord, Fill fill_mem)
         // Ensure corresponding physical block is order-aligned
         assert((virt_to_phys(virt) & ((1ul << (block->ord + PAGE_BITS)) - 1)) == 0);
 
-        fill(reinterpret_cast<void*>(virt), fill_mem, 1ul << (block->ord + PAGE_BITS));
-
         return reinterpret_cast<void*>(virt);
     }
 
-    Console::panic("Out of memory");
+    return nullptr;
 }
 
-/*
- * Free physically contiguous memory region.
- * @param virt     Linear block base address
- */
-void Buddy::free(mword virt)
+void Buddy::free_locked(mword virt)
 {
-    signed long idx = page_to_index(virt);
-
-    // Ensure virt is within allocator range
-    assert(idx >= min_idx && idx < max_idx);
-
-    Block* block = index_to_block(idx);
-
-    // Ensure block is marked as used
-    assert(block->tag == Block::Used);
+    Block* block = used_block(virt);
 
-    // Ensure corresponding physical block is order-aligned
-    assert((virt_to_phys(virt) & ((1ul << (block->ord + PAGE_BITS)) - 1)) == 0);
-
-    Lock_guard<Spinlock> guard(lock);
+    free_pages += 1ul << block->ord;
 
     unsigned short ord;
     for (ord = block->ord; ord < order - 1; ord++) {
@@ -173,3 +179,186 @@ void Buddy::free(mword virt)
     block->next = h->next;
     block->next->prev = h->next = block;
 }
+
+size_t Buddy::Order_backend::alloc_bulk(void** pages, size_t n)
+{
+    count_lock();
+    Lock_guard<Spinlock> guard(buddy.lock);
+
+    for (size_t i = 0; i < n; i++) {
+        pages[i] = buddy.alloc_locked(ord);
+
+        if (EXPECT_FALSE(pages[i] == nullptr)) {
+            return i;
+        }
+    }
+
+    return n;
+}
+
+void Buddy::Order_backend::free_bulk(void* const* pages, size_t n)
+{
+    count_lock();
+    Lock_guard<Spinlock> guard(buddy.lock);
+
+    for (size_t i = 0; i < n; i++) {
+        buddy.free_locked(reinterpret_cast<mword>(pages[i]));
+    }
+}
+
+void Buddy::drain_page_cache()
+{
+    while (zero_pool_count()) {
+        count_lock();
+        Lock_guard<Spinlock> guard(lock);
+        free_locked(reinterpret_cast<mword>(zero_pool()[--zero_pool_count()]));
+    }
+
+    for (unsigned short ord = 0; ord < NUM_CACHED_ORDERS; ord++) {
+        Order_backend backend{*this, ord};
+        page_cache()[ord].drain(backend);
+    }
+}
+
+void Buddy::drain_remote_page_caches()
+{
+    unsigned const request{Atomic::add(drain_request, 1U)};
+
+    Lapic::send_ipi_all_but_self(VEC_IPI_BDR);
+
+    uint64 const deadline{rdtsc() + static_cast<uint64>(Lapic::freq_tsc) * DRAIN_TIMEOUT_MS};
+
+    asm volatile("sti" : : : "memory");
+
+    for (unsigned cpu = 0; cpu < NUM_CPU; cpu++) {
+        if (cpu == Cpu::id() or !Hip::cpu_online(cpu))
+            continue;
+
+        while (static_cast<int>(remote_load_drained(cpu) - request) < 0 and rdtsc() < deadline)
+            pause();
+    }
+
+    asm volatile("cli" : : : "memory");
+}
+
+void Buddy::drain_handler()
+{
+    // Requests that arrive while we drain are covered by a later IPI.
+    unsigned const request{Atomic::load(allocator.drain_request)};
+
+    allocator.drain_page_cache();
+
+    Atomic::store(drained(), request);
+}
+
+/*
+ * Allocate physically contiguous memory region.
+ * @param ord       Block order (2^ord pages)
+ * @param fill      Initialization mode of allocated memory
+ * @return          Pointer to linear memory region
+ */
+void* Buddy::alloc(unsigned short ord, Fill fill_mem)
+{
+    bool const cached = ord < NUM_CACHED_ORDERS and Cpulocal::is_initialized();
+    void* ret = nullptr;
+
+    // Zeroed pages come from the pool, so we don't zero them on the critical
+    // path.
+    if (ord == 0 and fill_mem == FILL_0 and cached and zero_pool_count()) {
+        return zero_pool()[--zero_pool_count()];
+    }
+
+    if (EXPECT_TRUE(cached)) {
+        Order_backend backend{*this, ord};
+        ret = page_cache()[ord].alloc(backend);
+    }
+
+    if (EXPECT_FALSE(ret == nullptr)) {
+        count_lock();
+        Lock_guard<Spinlock> guard(lock);
+        ret = alloc_locked(ord);
+    }
+
+    // Pages of other orders may still sit in our page caches.
+    if (EXPECT_FALSE(ret == nullptr and Cpulocal::is_initialized())) {
+        drain_page_cache();
+
+        count_lock();
+        Lock_guard<Spinlock> guard(lock);
+        ret = alloc_locked(ord);
+    }
+
+    // The remaining free pages may sit in the page caches of other CPUs.
+    if (EXPECT_FALSE(ret == nullptr and Cpulocal::is_initialized())) {
+        drain_remote_page_caches();
+
+        count_lock();
+        Lock_guard<Spinlock> guard(lock);
+        ret = alloc_locked(ord);
+    }
+
+    if (EXPECT_FALSE(ret == nullptr)) {
+        Console::panic("Out of memory");
+    }
+
+    fill(ret, fill_mem, 1ul << (ord + PAGE_BITS));
+
+    return ret;
+}
+
+bool Buddy::refill_zero_pool()
+{
+    if (zero_pool_count() == NUM_ZERO_PAGES) {
+        return false;
+    }
+
+    void* page;
+
+    // We take pages directly from the global block lists. This must never
+    // fail hard and must not take pages from the page caches.
+    {
+        count_lock();
+        Lock_guard<Spinlock> guard(lock);
+
+        // When memory gets tight, alloc() drains the caches and pools of all
+        // CPUs. Stop before we would take these pages back.
+        if (free_pages <= ZERO_POOL_RESERVE) {
+            return false;
+        }
+
+        page = alloc_locked(0);
+    }
+
+    if (page == nullptr) {
+        return false;
+    }
+
+    // These pages may not be used for a while, so don't pollute the caches.
+    memzero_nt(page, PAGE_SIZE);
+
+    zero_pool()[zero_pool_count()++] = page;
+
+    return zero_pool_count() < NUM_ZERO_PAGES;
+}
+
+/*
+ * Free physically contiguous memory region.
+ * @param virt     Linear block base address
+ */
+void Buddy::free(mword virt)
+{
+    unsigned short ord = used_block(virt)->ord;
+
+    // Ensure corresponding physical block is order-aligned
+    assert((virt_to_phys(virt) & ((1ul << (ord + PAGE_BITS)) - 1)) == 0);
+
+    if (EXPECT_TRUE(ord < NUM_CACHED_ORDERS and Cpulocal::is_initialized())) {
+        Order_backend backend{*this, ord};
+        page_cache()[ord].free(backend, reinterpret_cast<void*>(virt));
+        return;
+    }
+
+    count_lock();
+    Lock_guard<Spinlock> guard(lock);
+    free_locked(virt);
+}
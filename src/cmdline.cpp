@@ -25,6 +25,7 @@
 struct Cmdline::param_map const Cmdline::map[] = {
     {"iommu", &Cmdline::iommu},   {"serial", &Cmdline::serial}, {"nodl", &Cmdline::nodl},
     {"nopcid", &Cmdline::nopcid}, {"novga", &Cmdline::novga},   {"novpid", &Cmdline::novpid},
+    {"x2apic", &Cmdline::x2apic},
 };
 
 char const* Cmdline::get_arg(char const** line, unsigned& len)
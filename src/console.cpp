@@ -22,6 +22,7 @@
 
 #include "console.hpp"
 #include "lock_guard.hpp"
+#include "spinlock.hpp"
 #include "x86.hpp"
 
 Console* Console::list;
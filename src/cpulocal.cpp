@@ -23,6 +23,7 @@
 #include "tss.hpp"
 
 alignas(PAGE_SIZE) Per_cpu Cpulocal::cpu[NUM_CPU];
+bool Cpulocal::initialized;
 
 Per_cpu& Cpulocal::get_remote(unsigned cpu_id)
 {
@@ -41,5 +42,7 @@ mword Cpulocal::setup_cpulocal()
     Msr::write(Msr::IA32_GS_BASE, gs_base);
     Msr::write(Msr::IA32_KERNEL_GS_BASE, 0);
 
+    initialized = true;
+
     return gs_base;
 }
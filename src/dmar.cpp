@@ -33,10 +33,12 @@ Dmar* Dmar::list;
 Dmar_ctx* Dmar::ctx = new Dmar_ctx;
 Dmar_irt* Dmar::irt = new Dmar_irt;
 uint32 Dmar::gcmd = GCMD_TE;
+bool Dmar::caching;
 
 Dmar::Dmar(Paddr p)
     : Forward_list<Dmar>(list), reg_base((hwdev_addr -= PAGE_SIZE) | (p & PAGE_MASK)),
-      invq(static_cast<Dmar_qi*>(Buddy::allocator.alloc(ord, Buddy::FILL_0))), invq_idx(0)
+      invq(static_cast<Dmar_qi*>(Buddy::allocator.alloc(ord, Buddy::FILL_0))), invq_idx(0), qi_seq(0),
+      qi_done(0)
 {
     Pd::kern->claim_mmio_page(reg_base, p & ~PAGE_MASK);
 
@@ -58,6 +60,10 @@ Dmar::Dmar(Paddr p)
         gcmd |= GCMD_QIE;
     }
 
+    if (cm()) {
+        caching = true;
+    }
+
     // FIXME: This is too early to know whether IR should be enabled. See #158.
     init();
 }
@@ -112,6 +118,37 @@ void Dmar::assign(unsigned long rid, Pd* p)
     c->set(address_width | p->did << 8, root | 1);
 }
 
+void Dmar::submit_flush_tlb(unsigned long did, mword base, mword order)
+{
+    assert(order >= PAGE_BITS and (base & ((1UL << order) - 1)) == 0);
+
+    // Regions that are too large for a page-selective invalidation take the
+    // whole domain with them. This is still better than a global flush.
+    unsigned const am{static_cast<unsigned>(order - PAGE_BITS)};
+    bool const page_selective{psi() and am <= mamv()};
+
+    Lock_guard<Spinlock> guard(qi_lock);
+
+    if (qi()) {
+        if (page_selective)
+            qi_submit(Dmar_qi_tlb_page(did, base, am));
+        else
+            qi_submit(Dmar_qi_tlb_dom(did));
+
+        qi_fence();
+        return;
+    }
+
+    if (page_selective)
+        write<uint64>(REG_IVA, base | am);
+
+    uint64 const granularity{page_selective ? 3ULL : 2ULL};
+
+    write<uint64>(REG_IOTLB, 1ULL << 63 | granularity << 60 | static_cast<uint64>(did) << 32);
+    while (read<uint64>(REG_IOTLB) & (1ULL << 63))
+        pause();
+}
+
 void Dmar::fault_handler()
 {
     for (uint32 fsts; fsts = read<uint32>(REG_FSTS), fsts & 0xff;) {
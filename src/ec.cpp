@@ -22,6 +22,7 @@
  */
 
 #include "ec.hpp"
+#include "buddy.hpp"
 #include "elf.hpp"
 #include "hip.hpp"
 #include "rcu.hpp"
@@ -86,10 +87,10 @@ Ec::Ec(Pd* own, mword sel, Pd* p, void (*f)(), unsigned c, unsigned e, mword u,
         regs.spec_ctrl = 0;
 
         if (Hip::feature() & Hip::FEAT_VMX) {
-            mword host_cr3 = pd->hpt.root() | (Cpu::feature(Cpu::FEAT_PCID) ? pd->did : 0);
-
-            regs.vmcs = new Vmcs(reinterpret_cast<mword>(sys_regs() + 1), pd->Space_pio::walk(), host_cr3,
-                                 pd->ept, c);
+            // The PCID is only known once the vCPU runs. See ret_user_vmresume.
+            regs.vmcs_host_cr3 = pd->hpt.root();
+            regs.vmcs = new Vmcs(reinterpret_cast<mword>(sys_regs() + 1), pd->Space_pio::walk(),
+                                 regs.vmcs_host_cr3, pd->ept, c);
 
             regs.nst_ctrl<Vmcs>();
 
@@ -198,6 +199,11 @@ void Ec::handle_hazard(mword hzd, void (*func)())
     if (hzd & HZD_RCU)
         Rcu::quiet();
 
+    // This needs to come before scheduling, because the shootdown may
+    // request a local TLB flush via HZD_SCHED.
+    if (hzd & HZD_CLEANUP)
+        Pd::flush_deferred_cleanup();
+
     if (hzd & HZD_SCHED) {
         current()->cont = func;
         Sc::schedule();
@@ -242,7 +248,7 @@ void Ec::handle_hazard(mword hzd, void (*func)())
 void Ec::ret_user_sysexit()
 {
     mword hzd = (Cpu::hazard() | current()->regs.hazard()) &
-                (HZD_RECALL | HZD_STEP | HZD_RCU | HZD_DS_ES | HZD_SCHED);
+                (HZD_RECALL | HZD_STEP | HZD_RCU | HZD_CLEANUP | HZD_DS_ES | HZD_SCHED);
     if (EXPECT_FALSE(hzd))
         handle_hazard(hzd, ret_user_sysexit);
 
@@ -302,7 +308,8 @@ void Ec::return_to_user()
 void Ec::ret_user_iret()
 {
     // No need to check HZD_DS_ES because IRET will reload both anyway
-    mword hzd = (Cpu::hazard() | current()->regs.hazard()) & (HZD_RECALL | HZD_STEP | HZD_RCU | HZD_SCHED);
+    mword hzd = (Cpu::hazard() | current()->regs.hazard()) &
+                (HZD_RECALL | HZD_STEP | HZD_RCU | HZD_CLEANUP | HZD_SCHED);
     if (EXPECT_FALSE(hzd))
         handle_hazard(hzd, ret_user_iret);
 
@@ -329,7 +336,8 @@ void Ec::ret_user_iret()
 
 void Ec::ret_user_vmresume()
 {
-    mword hzd = (Cpu::hazard() | current()->regs.hazard()) & (HZD_RECALL | HZD_TSC | HZD_RCU | HZD_SCHED);
+    mword hzd = (Cpu::hazard() | current()->regs.hazard()) &
+                (HZD_RECALL | HZD_TSC | HZD_RCU | HZD_CLEANUP | HZD_SCHED);
     if (EXPECT_FALSE(hzd))
         handle_hazard(hzd, ret_user_vmresume);
 
@@ -337,6 +345,11 @@ void Ec::ret_user_vmresume()
 
     regs.vmcs->make_current();
 
+    if (EXPECT_FALSE(regs.vmcs_host_cr3 != Pd::host_cr3())) {
+        current()->regs.vmcs_host_cr3 = Pd::host_cr3();
+        Vmcs::write(Vmcs::HOST_CR3, Pd::host_cr3());
+    }
+
     if (EXPECT_FALSE(Pd::current()->stale_guest_tlb.chk(Cpu::id()))) {
         Pd::current()->stale_guest_tlb.clr(Cpu::id());
 
@@ -393,7 +406,8 @@ void Ec::ret_user_vmresume()
 
 void Ec::ret_user_vmrun()
 {
-    mword hzd = (Cpu::hazard() | current()->regs.hazard()) & (HZD_RECALL | HZD_TSC | HZD_RCU | HZD_SCHED);
+    mword hzd = (Cpu::hazard() | current()->regs.hazard()) &
+                (HZD_RECALL | HZD_TSC | HZD_RCU | HZD_CLEANUP | HZD_SCHED);
     if (EXPECT_FALSE(hzd))
         handle_hazard(hzd, ret_user_vmrun);
 
@@ -415,13 +429,16 @@ void Ec::ret_user_vmrun()
                   "vmrun %%rax;"
                   "vmsave %%rax;"
                   EXPAND (SAVE_GPR)
-                  "mov %1, %%rax;"
+                  // All general purpose registers hold guest state at this
+                  // point, so the root VMCB needs to be loaded %gs-relative.
+                  "mov %%gs:%c1, %%rax;" // Per_cpu::vmcb_root
                   "mov %%gs:0, %%rsp;" // Per_cpu::self
                   "vmload %%rax;"
                   "cli;"
                   "stgi;"
                   "jmp svm_handler;"
-                  : : "m" (current()->regs), "m" (Vmcb::root) : "memory");
+                  : : "m" (current()->regs),
+                      "i" (OFFSETOF(Per_cpu, vmcb_root) - OFFSETOF(Per_cpu, self)) : "memory");
     // clang-format on
 
     UNREACHED;
@@ -431,10 +448,18 @@ void Ec::idle()
 {
     for (;;) {
 
-        mword hzd = Cpu::hazard() & (HZD_RCU | HZD_SCHED);
+        mword hzd = Cpu::hazard() & (HZD_RCU | HZD_CLEANUP | HZD_SCHED);
         if (EXPECT_FALSE(hzd))
             handle_hazard(hzd, idle);
 
+        // Use idle time to zero pages for later allocations. We zero one page
+        // at a time and open a short interrupt window in between to not delay
+        // interrupts.
+        if (Buddy::allocator.refill_zero_pool()) {
+            asm volatile("sti; nop; cli" : : : "memory");
+            continue;
+        }
+
         asm volatile("sti; hlt; cli" : : : "memory");
     }
 }
@@ -0,0 +1,176 @@
+/*
+ * Cross-CPU Portal Calls
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+// A portal call to a handler EC on another CPU works as follows:
+//
+// The caller fills in the request that is embedded in its EC, adds it to the
+// mailbox of the handler's CPU and blocks. Only a request that is added to an
+// empty mailbox needs a VEC_IPI_XCL IPI.
+//
+// On the handler's CPU, the IPI wakes up the xcall proxy. This is a kernel EC
+// with its own SC that takes requests out of the mailbox one by one and calls
+// the handler on behalf of the remote caller. The handler runs on the SC of
+// the proxy and reads its message from the UTCB of the caller.
+//
+// When the handler replies, the reply goes directly into the UTCB of the
+// caller and the caller is released on its CPU. The proxy then continues
+// with the next request.
+//
+// Each CPU has only one proxy, so a handler that takes a long time to reply
+// holds up all other requests to its CPU. A handler that is served by the
+// proxy must not make a cross-CPU call itself: if the callee in turn called
+// back into the first CPU, both proxies would wait for each other forever.
+// Such calls fail with BAD_CPU, see sys_call().
+
+#include "ec.hpp"
+#include "lapic.hpp"
+#include "pt.hpp"
+#include "rcu.hpp"
+#include "vectors.hpp"
+
+void Ec::create_xcall_proxy()
+{
+    Ec* proxy = xcall_proxy() = new Ec(&Pd::kern, Cpu::id());
+
+    // The proxy stays blocked until the first request arrives.
+    proxy->cont = nullptr;
+
+    // Remote calls run with the default priority. Services that need a
+    // different priority still need a handler on each CPU.
+    Sc* sc = new Sc(&Pd::kern, Cpu::id(), proxy, Cpu::id(), Sc::default_prio, Sc::default_quantum);
+
+    // The SC waits on the proxy just as if the proxy had blocked itself,
+    // which includes the additional reference of block_sc().
+    bool ok = sc->add_ref();
+    assert(ok);
+
+    proxy->enqueue(sc);
+}
+
+void Ec::xcall_handler()
+{
+    if (Ec* proxy = xcall_proxy(); EXPECT_TRUE(proxy))
+        proxy->release(xcall_serve);
+}
+
+void Ec::send_xcall(Pt* pt)
+{
+    Ec* self = current();
+    Ec* ec = pt->ec;
+    Xcall& x = self->xcall;
+
+    bool ok = self->add_ref();
+    assert(ok);
+    ok = ec->add_ref();
+    assert(ok);
+
+    x.caller = self;
+    x.handler = ec;
+    x.id = pt->id;
+    x.ip = pt->ip;
+
+    self->cont = ret_user_sysexit;
+    Atomic::store(x.waiting, true);
+
+    if (remote_ref_xcall_mailbox(ec->cpu).enqueue(&x))
+        Lapic::send_ipi(ec->cpu, VEC_IPI_XCL);
+
+    // If the reply is already there, block_sc() returns immediately.
+    self->block_sc();
+    self->return_to_user();
+}
+
+void Ec::xcall_serve()
+{
+    Ec* proxy = current();
+
+    for (;;) {
+        Xcall* x = xcall_pending();
+
+        if (!x)
+            x = xcall_pending() = xcall_mailbox().dequeue_all();
+
+        if (!x) {
+            // A request that arrives from now on comes with an IPI, which
+            // releases us again.
+            proxy->cont = nullptr;
+            proxy->block_sc();
+            continue;
+        }
+
+        Ec* ec = x->handler;
+
+        if (EXPECT_TRUE(!ec->cont)) {
+            xcall_pending() = x->next;
+            x->next = nullptr;
+
+            proxy->partner = ec;
+            proxy->chain_append(ec);
+            ec->rcap = x->caller;
+            ec->cont = recv_user;
+            ec->regs.set_pt(x->id);
+            ec->regs.set_ip(x->ip);
+            ec->return_to_user();
+        }
+
+        // The handler is busy. We keep the request and try again once the
+        // handler is done.
+        ec->help(xcall_serve);
+
+        // The handler is dead.
+        xcall_pending() = x->next;
+        x->next = nullptr;
+
+        x->caller->cont = sys_finish<Sys_regs::COM_TIM>;
+        xcall_complete(x);
+    }
+}
+
+void Ec::xcall_reply()
+{
+    Ec* ec = current();
+    Ec* proxy = xcall_proxy();
+
+    assert(proxy->partner == ec);
+
+    Xcall* x = &ec->rcap->xcall;
+
+    proxy->chain_truncate();
+    proxy->partner = nullptr;
+    ec->rcap = nullptr;
+
+    xcall_complete(x);
+
+    Sc::current()->ec->activate();
+}
+
+void Ec::xcall_complete(Xcall* x)
+{
+    Ec* caller = x->caller;
+    Ec* ec = x->handler;
+
+    x->caller = x->handler = nullptr;
+
+    if (ec->del_rcu())
+        Rcu::call(ec);
+
+    // The flag is cleared under the lock of the caller. Otherwise, the
+    // caller could see it cleared before its SC is released, return to
+    // userspace and block on its next call, which we would then release.
+    caller->release(nullptr, [x] { Atomic::store(x->waiting, false); });
+
+    if (caller->del_rcu())
+        Rcu::call(caller);
+}
@@ -20,6 +20,7 @@
 #include "mdb.hpp"
 
 Ept::level_t Ept::supported_leaf_levels{1};
+bool Ept::ad_bits{false};
 
 static Ept::pte_t attr_from_hpt(mword a)
 {
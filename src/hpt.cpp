@@ -22,29 +22,39 @@
 
 Hpt::level_t Hpt::supported_leaf_levels{2};
 
-Hpt Hpt::deep_copy(mword vaddr_start, mword vaddr_end)
+// The kernel mappings need to be covered by a single entry at this level to
+// be able to share them with one page table entry.
+static constexpr Hpt::level_t KERNEL_SHARE_LEVEL{2};
+
+static_assert(LINK_ADDR >> 30 == (SPC_LOCAL - 1) >> 30, "Kernel mappings need to fit into a single 1GB region");
+
+void Hpt::share_kernel(Hpt& src)
 {
-    Hpt::Mapping map;
-    Hpt dst;
     Tlb_cleanup cleanup;
+    pte_t const entry{src.entry_at(LINK_ADDR, KERNEL_SHARE_LEVEL)};
+
+    assert((entry & PTE_P) and not(entry & PTE_S));
 
-    for (mword vaddr{vaddr_start}; vaddr < vaddr_end; vaddr += map.size()) {
-        map = lookup(vaddr);
+    link_table(cleanup, LINK_ADDR, KERNEL_SHARE_LEVEL, entry);
 
-        if (not(map.present())) {
-            continue;
-        }
+    // We populate a page table that is not yet used anywhere.
+    assert(not cleanup.need_tlb_flush());
+}
 
-        // We don't handle the case where vaddr_start and vaddr_end point into
-        // the middle mappings, but this case should also never happen.
-        assert(map.vaddr >= vaddr_start and map.vaddr + map.size() <= vaddr_end);
-        dst.update(cleanup, map);
+void Hpt::unshare_kernel(Hpt& src)
+{
+    // Leave any other page table alone. It belongs to this page table and is
+    // freed with it.
+    if (entry_at(LINK_ADDR, KERNEL_SHARE_LEVEL) != src.entry_at(LINK_ADDR, KERNEL_SHARE_LEVEL)) {
+        return;
     }
 
-    // We populate an empty page table that is also not yet used anywhere.
-    assert(not cleanup.need_tlb_flush());
+    Tlb_cleanup cleanup;
+
+    unlink_table(cleanup, LINK_ADDR, KERNEL_SHARE_LEVEL);
 
-    return dst;
+    // The page table is about to be destroyed and is not in use anymore.
+    cleanup.ignore_tlb_flush();
 }
 
 Hpt& Hpt::boot_hpt()
@@ -81,6 +91,7 @@ void* Hpt::remap(Paddr phys, bool use_boot_hpt)
 
     // We always need to flush the TLB.
     hpt.flush();
+    cleanup.ignore_tlb_flush();
 
     return reinterpret_cast<void*>(SPC_LOCAL_REMAP + offset);
 }
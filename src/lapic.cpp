@@ -25,6 +25,8 @@
 
 #include "lapic.hpp"
 #include "acpi.hpp"
+#include "acpi_madt.hpp"
+#include "buddy.hpp"
 #include "cmdline.hpp"
 #include "ec.hpp"
 #include "msr.hpp"
@@ -36,6 +38,7 @@
 unsigned Lapic::freq_tsc;
 unsigned Lapic::freq_bus;
 bool Lapic::use_tsc_timer{false};
+bool Lapic::x2apic{false};
 unsigned Lapic::cpu_park_count;
 
 static char __start_cpu_backup[128];
@@ -89,13 +92,27 @@ void Lapic::restore_low_memory()
 
 void Lapic::init()
 {
-    Paddr apic_base = Msr::read(Msr::IA32_APIC_BASE);
+    Paddr apic_base = Msr::read(Msr::IA32_APIC_BASE) | 0x800;
+
+    // x2APIC mode is opt-in and only used while all APIC IDs fit into the 8
+    // bits we keep per CPU. Once the firmware has enabled x2APIC mode, we
+    // cannot go back without disabling the LAPIC.
+    x2apic = (apic_base & 0x400) || (Cmdline::x2apic && Cpu::feature(Cpu::FEAT_X2APIC) &&
+                                     !Acpi_table_madt::wide_apic_ids);
+
+    // The transition from disabled to x2APIC mode has to go through xAPIC mode.
+    Msr::write(Msr::IA32_APIC_BASE, apic_base);
 
-    Msr::write(Msr::IA32_APIC_BASE, apic_base | 0x800);
+    if (x2apic && !(apic_base & 0x400))
+        Msr::write(Msr::IA32_APIC_BASE, apic_base |= 0x400);
+
+    if (EXPECT_FALSE(id() > 0xff))
+        Console::panic("APIC ID %#x does not fit into 8 bits", id());
 
     assert(Cpu::id() == Cpu::find_by_apic_id(id()));
 
-    Cpu::lapic_info[Cpu::id()].id = read(LAPIC_IDR);
+    // Report the ID in xAPIC format to keep the HIP stable.
+    Cpu::lapic_info[Cpu::id()].id = x2apic ? id() << 24 : read(LAPIC_IDR);
     Cpu::lapic_info[Cpu::id()].version = read(LAPIC_LVR);
     Cpu::lapic_info[Cpu::id()].svr = read(LAPIC_SVR);
 
@@ -164,13 +181,24 @@ void Lapic::init()
     set_lvt(LAPIC_LVT_TIMER, DLV_FIXED, VEC_LVT_TIMER, use_tsc_timer ? 2U << 17 : 0);
 
     write(LAPIC_TMR_ICR, 0);
+    timer_deadline() = 0;
 
-    trace(TRACE_APIC, "APIC:%#lx ID:%#x VER:%#x LVT:%#x (%s Mode)", apic_base & ~PAGE_MASK, id(), version(),
-          lvt_max(), freq_bus ? "OS" : "DL");
+    trace(TRACE_APIC, "APIC:%#lx ID:%#x VER:%#x LVT:%#x (%s Mode%s)", apic_base & ~PAGE_MASK, id(), version(),
+          lvt_max(), freq_bus ? "OS" : "DL", x2apic ? ", x2APIC" : "");
 }
 
 void Lapic::send_ipi(unsigned cpu, unsigned vector, Delivery_mode dlv, Shorthand dsh)
 {
+    if (x2apic) {
+        // Unlike the MMIO write, the WRMSR to the ICR is not ordered against
+        // earlier stores. The receiver must see everything we wrote before.
+        asm volatile("mfence" : : : "memory");
+
+        Msr::write(x2apic_msr(LAPIC_ICR_LO),
+                   static_cast<uint64>(Cpu::apic_id[cpu]) << 32 | dsh | 1U << 14 | dlv | vector);
+        return;
+    }
+
     while (EXPECT_FALSE(read(LAPIC_ICR_LO) & 1U << 12))
         pause();
 
@@ -186,7 +214,7 @@ void Lapic::park_all_but_self(park_fn fn)
     Atomic::store(park_function, fn);
     Atomic::store(cpu_park_count, Cpu::online - 1);
 
-    send_ipi(0, VEC_IPI_PRK, DLV_FIXED, DSH_EXC_SELF);
+    send_ipi_all_but_self(VEC_IPI_PRK);
 
     while (Atomic::load(cpu_park_count) != 0) {
         pause();
@@ -208,8 +236,11 @@ void Lapic::error_handler()
 void Lapic::timer_handler()
 {
     bool expired = (use_tsc_timer ? Msr::read(Msr::IA32_TSC_DEADLINE) : read(LAPIC_TMR_CCR)) == 0;
-    if (expired)
+    if (expired) {
+        // The timer disarms itself when it fires.
+        timer_deadline() = 0;
         Timeout::check();
+    }
 
     Rcu::update();
 }
@@ -257,6 +288,12 @@ void Lapic::ipi_vector(unsigned vector)
     case VEC_IPI_PRK:
         park_handler();
         break;
+    case VEC_IPI_XCL:
+        Ec::xcall_handler();
+        break;
+    case VEC_IPI_BDR:
+        Buddy::drain_handler();
+        break;
     }
 
     eoi();
@@ -19,10 +19,13 @@
  */
 
 #include "pd.hpp"
+#include "counter.hpp"
+#include "hazards.hpp"
 #include "hip.hpp"
 #include "mtrr.hpp"
 #include "stdio.hpp"
 #include "svm.hpp"
+#include "trace.hpp"
 
 INIT_PRIORITY(PRIO_SLAB)
 Slab_cache Pd::cache(sizeof(Pd), 32);
@@ -51,6 +54,12 @@ Pd::Pd() : Typed_kobject(static_cast<Space_obj*>(this)), Space_pio(this)
     Paddr frame_h = Buddy::ptr_to_phys(&PAGE_H);
     mark_avail_phys(frame_h, frame_h + PAGE_SIZE, 1);
 
+    // Trace rings, which userspace can only map via machine_ctrl_trace.
+    for (unsigned cpu = 0; cpu < NUM_CPU; cpu++) {
+        Paddr ring = Trace::ring_phys(cpu);
+        mark_avail_phys(ring, ring + sizeof(Trace::Ring), 1);
+    }
+
     // I/O Ports
     Space_pio::addreg(0, 1UL << 16, 7);
 }
@@ -112,8 +121,9 @@ Tlb_cleanup Pd::delegate<Space_mem>(Pd* snd, mword const snd_base, mword const r
     return Space_mem::delegate(snd, snd_base << PAGE_BITS, rcv_base << PAGE_BITS, ord + PAGE_BITS, attr, sub);
 }
 
-template <typename S> void Pd::revoke(mword const base, mword const ord, mword const attr, bool self)
+template <typename S> Tlb_cleanup Pd::revoke(mword const base, mword const ord, mword const attr, bool self)
 {
+    Tlb_cleanup cleanup;
     Mdb* mdb;
     for (mword addr = base; (mdb = S::tree_lookup(addr, true));
          addr = mdb->node_base + (1UL << mdb->node_order)) {
@@ -134,7 +144,7 @@ template <typename S> void Pd::revoke(mword const base, mword const ord, mword c
                                o) != ~0UL;
 
             if (demote && node->node_attr & attr) {
-                static_cast<S*>(node->space)->update(node, attr);
+                cleanup.merge(static_cast<S*>(node->space)->update(node, attr));
                 node->demote_node(attr);
             }
 
@@ -162,9 +172,12 @@ template <typename S> void Pd::revoke(mword const base, mword const ord, mword c
 
         assert(node == mdb);
     }
+
+    return cleanup;
 }
 
-template <> void Pd::revoke<Space_mem>(mword const base, mword const ord, mword const attr, bool self)
+template <>
+Tlb_cleanup Pd::revoke<Space_mem>(mword const base, mword const ord, mword const attr, bool self)
 {
     if (not self) {
         trace(TRACE_ERROR, "Non-self revocation is not supported: Revoking everything!");
@@ -172,8 +185,64 @@ template <> void Pd::revoke<Space_mem>(mword const base, mword const ord, mword
 
     Tlb_cleanup cleanup{Space_mem::revoke(base << PAGE_BITS, ord + PAGE_BITS, attr)};
 
-    shootdown();
-    cleanup.ignore_tlb_flush();
+    // Revoked rights must be gone from all TLBs when the revoke returns, even
+    // if the page tables themselves did not signal a flush.
+    cleanup.flush_tlb_later();
+
+    return cleanup;
+}
+
+void Pd::defer_cleanup(Tlb_cleanup& batch, Tlb_cleanup& item)
+{
+    if (batch.need_tlb_flush() and item.need_tlb_flush())
+        Counter::shootdown_coalesced()++;
+
+    batch.merge(item);
+}
+
+void Pd::flush_cleanup(Tlb_cleanup& batch)
+{
+    if (batch.need_tlb_flush()) {
+        shootdown();
+        batch.ignore_tlb_flush(); // because it is done.
+    }
+
+    // All CPUs have flushed their TLBs, so page tables that were removed
+    // from the page tables can be reused.
+    batch.free_pages_now();
+}
+
+// The pages of free_page_after_flush() on each CPU. The list is threaded
+// through the allocator metadata like the one of Tlb_cleanup and is only
+// accessed with interrupts disabled on its own CPU.
+static mword deferred_pages[NUM_CPU];
+
+void Pd::free_page_after_flush(void* page)
+{
+    mword const addr{reinterpret_cast<mword>(page)};
+
+    Buddy::allocator.set_link(addr, deferred_pages[Cpu::id()]);
+    deferred_pages[Cpu::id()] = addr;
+
+    Cpu::hazard() |= HZD_CLEANUP;
+}
+
+void Pd::flush_deferred_cleanup()
+{
+    Cpu::hazard() &= ~HZD_CLEANUP;
+
+    // Interrupts that arrive during the shootdown may defer more pages, so
+    // we take over the current ones first.
+    Tlb_cleanup batch;
+
+    for (mword page{deferred_pages[Cpu::id()]}, next; page != 0; page = next) {
+        next = Buddy::allocator.get_link(page);
+        batch.free_later(reinterpret_cast<Tlb_cleanup::pointer>(page));
+    }
+
+    deferred_pages[Cpu::id()] = 0;
+
+    flush_cleanup(batch);
 }
 
 mword Pd::clamp(mword snd_base, mword& rcv_base, mword snd_ord, mword rcv_ord)
@@ -261,6 +330,14 @@ void Pd::xlt_crd(Pd* pd, Crd xlt, Crd& crd)
 }
 
 void Pd::del_crd(Pd* pd, Crd del, Crd& crd, mword sub, mword hot)
+{
+    Tlb_cleanup batch;
+
+    del_crd(pd, del, crd, batch, sub, hot);
+    flush_cleanup(batch);
+}
+
+void Pd::del_crd(Pd* pd, Crd del, Crd& crd, Tlb_cleanup& batch, mword sub, mword hot)
 {
     Crd::Type st = crd.type(), rt = del.type();
     Tlb_cleanup cleanup;
@@ -278,18 +355,21 @@ void Pd::del_crd(Pd* pd, Crd del, Crd& crd, mword sub, mword hot)
     case Crd::MEM:
         o = clamp(sb, rb, so, ro, hot);
         trace(TRACE_DEL, "DEL MEM PD:%p->%p SB:%#010lx RB:%#010lx O:%#04lx A:%#lx", pd, this, sb, rb, o, a);
+        Trace::record(TRACE_DEL, Trace::DELEGATE_MEM, pd, this, sb, rb, o);
         cleanup = delegate<Space_mem>(pd, sb, rb, o, a, sub, "MEM");
         break;
 
     case Crd::PIO:
         o = clamp(sb, rb, so, ro);
         trace(TRACE_DEL, "DEL I/O PD:%p->%p SB:%#010lx RB:%#010lx O:%#04lx A:%#lx", pd, this, rb, rb, o, a);
+        Trace::record(TRACE_DEL, Trace::DELEGATE_PIO, pd, this, rb, o);
         cleanup = delegate<Space_pio>(pd, rb, rb, o, a, sub, "PIO");
         break;
 
     case Crd::OBJ:
         o = clamp(sb, rb, so, ro, hot);
         trace(TRACE_DEL, "DEL OBJ PD:%p->%p SB:%#010lx RB:%#010lx O:%#04lx A:%#lx", pd, this, sb, rb, o, a);
+        Trace::record(TRACE_DEL, Trace::DELEGATE_OBJ, pd, this, sb, rb, o);
         cleanup = delegate<Space_obj>(pd, sb, rb, o, a, 0, "OBJ");
         break;
     }
@@ -300,37 +380,56 @@ void Pd::del_crd(Pd* pd, Crd del, Crd& crd, mword sub, mword hot)
         /* if FRAME_0 got replaced by real pages we have to tell all cpus, done below by shootdown */
         this->stale_host_tlb.merge(cpus);
 
-    if (cleanup.need_tlb_flush()) {
-        shootdown();
-        cleanup.ignore_tlb_flush(); // because it is done.
-    }
+    defer_cleanup(batch, cleanup);
 }
 
 void Pd::rev_crd(Crd crd, bool self)
 {
+    Tlb_cleanup batch;
+
+    rev_crd(crd, self, batch);
+    flush_cleanup(batch);
+}
+
+void Pd::rev_crd(Crd crd, bool self, Tlb_cleanup& batch)
+{
+    Tlb_cleanup cleanup;
+
     switch (crd.type()) {
 
     case Crd::MEM:
         trace(TRACE_REV, "REV MEM PD:%p B:%#010lx O:%#04x A:%#04x %s", this, crd.base(), crd.order(),
               crd.attr(), self ? "+" : "-");
-        revoke<Space_mem>(crd.base(), crd.order(), crd.attr(), self);
+        cleanup = revoke<Space_mem>(crd.base(), crd.order(), crd.attr(), self);
         break;
 
     case Crd::PIO:
         trace(TRACE_REV, "REV I/O PD:%p B:%#010lx O:%#04x A:%#04x %s", this, crd.base(), crd.order(),
               crd.attr(), self ? "+" : "-");
-        revoke<Space_pio>(crd.base(), crd.order(), crd.attr(), self);
+        cleanup = revoke<Space_pio>(crd.base(), crd.order(), crd.attr(), self);
         break;
 
     case Crd::OBJ:
         trace(TRACE_REV, "REV OBJ PD:%p B:%#010lx O:%#04x A:%#04x %s", this, crd.base(), crd.order(),
               crd.attr(), self ? "+" : "-");
-        revoke<Space_obj>(crd.base(), crd.order(), crd.attr(), self);
+        cleanup = revoke<Space_obj>(crd.base(), crd.order(), crd.attr(), self);
         break;
     }
+
+    defer_cleanup(batch, cleanup);
 }
 
 Xfer Pd::xfer_item(Pd* src_pd, Crd xlt, Crd del, Xfer s_ti)
+{
+    Tlb_cleanup batch;
+    Xfer const res{xfer_item(src_pd, xlt, del, s_ti, batch)};
+
+    flush_cleanup(batch);
+
+    return res;
+}
+
+Xfer Pd::xfer_item(Pd* src_pd, Crd xlt, Crd del, Xfer s_ti, Tlb_cleanup& batch)
 {
     mword set_as_del = 0;
     Crd crd = s_ti.crd();
@@ -351,8 +450,8 @@ Xfer Pd::xfer_item(Pd* src_pd, Crd xlt, Crd del, Xfer s_ti)
         set_as_del = 1;
         FALL_THROUGH;
     case Xfer::Kind::DELEGATE:
-        del_crd(src_pd->is_priv && s_ti.from_kern() ? &kern : src_pd, del, crd, s_ti.subspaces(),
-                s_ti.hotspot());
+        del_crd(src_pd->is_priv && s_ti.from_kern() ? &kern : src_pd, del, crd, batch,
+                s_ti.subspaces(), s_ti.hotspot());
         break;
 
     default:
@@ -365,13 +464,19 @@ Xfer Pd::xfer_item(Pd* src_pd, Crd xlt, Crd del, Xfer s_ti)
 
 void Pd::xfer_items(Pd* src_pd, Crd xlt, Crd del, Xfer* s_ti, Xfer* d_ti, unsigned long num_typed)
 {
+    // Delegations only need their TLB shootdown before the receiver runs
+    // again, so all items share a single one.
+    Tlb_cleanup batch;
+
     for (unsigned long cur = 0; cur < num_typed; cur++) {
-        Xfer res{xfer_item(src_pd, xlt, del, *(s_ti - cur))};
+        Xfer res{xfer_item(src_pd, xlt, del, *(s_ti - cur), batch)};
 
         if (d_ti) {
             *(d_ti - cur) = res;
         }
     }
+
+    flush_cleanup(batch);
 }
 
 void* Pd::get_access_page()
@@ -24,6 +24,7 @@
 #include "lapic.hpp"
 #include "stdio.hpp"
 #include "timeout_budget.hpp"
+#include "trace.hpp"
 #include "vectors.hpp"
 
 INIT_PRIORITY(PRIO_SLAB)
@@ -56,20 +57,11 @@ void Sc::ready_enqueue(uint64 t, bool inc_ref)
             return;
     }
 
-    if (prio > prio_top())
-        prio_top() = prio;
+    ready().enqueue(this, prio, left != 0);
 
-    if (!list()[prio])
-        list()[prio] = prev = next = this;
-    else {
-        next = list()[prio];
-        prev = list()[prio]->prev;
-        next->prev = prev->next = this;
-        if (left)
-            list()[prio] = this;
-    }
+    Trace::record(TRACE_SCHEDULE, Trace::SC_ENQUEUE, this, prio, left);
 
-    trace(TRACE_SCHEDULE, "ENQ:%p (%llu) PRIO:%#x TOP:%#x %s", this, left, prio, prio_top(),
+    trace(TRACE_SCHEDULE, "ENQ:%p (%llu) PRIO:%#x TOP:%#x %s", this, left, prio, ready().top_prio(),
           prio > current()->prio ? "reschedule" : "");
 
     if (prio > current()->prio || (this != current() && prio == current()->prio && left))
@@ -85,19 +77,12 @@ void Sc::ready_dequeue(uint64 t)
 {
     assert(prio < NUM_PRIORITIES);
     assert(cpu == Cpu::id());
-    assert(prev && next);
-
-    if (list()[prio] == this)
-        list()[prio] = next == this ? nullptr : next;
 
-    next->prev = prev;
-    prev->next = next;
-    prev = next = nullptr;
+    ready().dequeue(this, prio);
 
-    while (!list()[prio_top()] && prio_top())
-        prio_top()--;
+    Trace::record(TRACE_SCHEDULE, Trace::SC_DEQUEUE, this, prio, left);
 
-    trace(TRACE_SCHEDULE, "DEQ:%p (%llu) PRIO:%#x TOP:%#x", this, left, prio, prio_top());
+    trace(TRACE_SCHEDULE, "DEQ:%p (%llu) PRIO:%#x TOP:%#x", this, left, prio, ready().top_prio());
 
     ec->add_tsc_offset(tsc - t);
 
@@ -122,13 +107,11 @@ void Sc::schedule(bool suspend)
     else if (current()->del_rcu())
         Rcu::call(current());
 
-    Sc* sc = list()[prio_top()];
+    Sc* sc = ready().top();
     assert(sc);
 
     Timeout_budget::budget()->enqueue(t + sc->left);
 
-    ctr_loop() = 0;
-
     current() = sc;
     sc->ready_dequeue(t);
     sc->ec->activate();
@@ -147,16 +130,9 @@ void Sc::remote_enqueue(bool inc_ref)
                 return;
         }
 
-        Rq* r = remote(cpu);
-
-        Lock_guard<Spinlock> guard(r->lock);
-
-        if (r->queue) {
-            next = r->queue;
-            prev = r->queue->prev;
-            next->prev = prev->next = this;
-        } else {
-            r->queue = prev = next = this;
+        // Only the first SC in the queue needs an IPI. The remote CPU picks up
+        // all SCs that follow while it handles it.
+        if (remote(cpu)->enqueue(this)) {
             Lapic::send_ipi(cpu, VEC_IPI_RRQ);
         }
     }
@@ -166,21 +142,15 @@ void Sc::rrq_handler()
 {
     uint64 t = rdtsc();
 
-    Lock_guard<Spinlock> guard(rq().lock);
-
-    for (Sc* ptr = rq().queue; ptr;) {
-
-        ptr->next->prev = ptr->prev;
-        ptr->prev->next = ptr->next;
+    for (Sc* ptr = rq().dequeue_all(); ptr;) {
 
         Sc* sc = ptr;
 
-        ptr = ptr->next == ptr ? nullptr : ptr->next;
+        ptr = ptr->next;
+        sc->next = nullptr;
 
         sc->ready_enqueue(t, false);
     }
-
-    rq().queue = nullptr;
 }
 
 void Sc::rke_handler()
@@ -20,6 +20,7 @@
 
 #include "slab.hpp"
 #include "assert.hpp"
+#include "atomic.hpp"
 #include "lock_guard.hpp"
 #include "math.hpp"
 #include "stdio.hpp"
@@ -53,11 +54,15 @@ void Slab::free(void* ptr)
     head = link;
 }
 
+unsigned Slab_cache::magazine_ctr;
+
 Slab_cache::Slab_cache(unsigned long elem_size, unsigned elem_align)
-    : curr(nullptr), head(nullptr), size(align_up(elem_size, sizeof(mword))),
+    : curr(nullptr), head(nullptr),
+      magazine(min(Atomic::add(magazine_ctr, 1U) - 1, static_cast<unsigned>(NUM_SLAB_MAGAZINES))),
+      size(align_up(elem_size, sizeof(mword))),
       buff(align_up(size + sizeof(mword), elem_align)), elem((PAGE_SIZE - sizeof(Slab)) / buff)
 {
-    trace(TRACE_MEMORY, "Slab Cache:%p (S:%lu A:%u)", this, elem_size, elem_align);
+    trace(TRACE_MEMORY, "Slab Cache:%p (S:%lu A:%u M:%u)", this, elem_size, elem_align, magazine);
 }
 
 void Slab_cache::grow()
@@ -71,26 +76,45 @@ void Slab_cache::grow()
     head = curr = slab;
 }
 
-void* Slab_cache::alloc(Buddy::Fill fill_mem)
+void* Slab_cache::alloc_locked()
 {
-    void* ret;
+    if (EXPECT_FALSE(!curr)) {
+        grow();
+    }
 
-    {
-        Lock_guard<Spinlock> guard(lock);
+    assert(!curr->full());
+    assert(!curr->next || curr->next->full());
 
-        if (EXPECT_FALSE(!curr)) {
-            grow();
-        }
+    // Allocate from slab
+    void* ret = curr->alloc();
 
-        assert(!curr->full());
-        assert(!curr->next || curr->next->full());
+    if (EXPECT_FALSE(curr->full())) {
+        curr = curr->prev;
+    }
 
-        // Allocate from slab
-        ret = curr->alloc();
+    return ret;
+}
 
-        if (EXPECT_FALSE(curr->full())) {
-            curr = curr->prev;
-        }
+size_t Slab_cache::alloc_bulk(void** objs, size_t n)
+{
+    Lock_guard<Spinlock> guard(lock);
+
+    for (size_t i = 0; i < n; i++) {
+        objs[i] = alloc_locked();
+    }
+
+    return n;
+}
+
+void* Slab_cache::alloc(Buddy::Fill fill_mem)
+{
+    void* ret;
+
+    if (EXPECT_TRUE(has_magazine())) {
+        ret = magazines()[magazine].alloc(*this);
+    } else {
+        Lock_guard<Spinlock> guard(lock);
+        ret = alloc_locked();
     }
 
     Buddy::fill(ret, fill_mem, size);
@@ -98,10 +122,8 @@ void* Slab_cache::alloc(Buddy::Fill fill_mem)
     return ret;
 }
 
-void Slab_cache::free(void* ptr)
+void Slab_cache::free_locked(void* ptr)
 {
-    Lock_guard<Spinlock> guard(lock);
-
     Slab* slab = reinterpret_cast<Slab*>(reinterpret_cast<mword>(ptr) & ~PAGE_MASK);
 
     bool was_full = slab->full();
@@ -163,3 +185,22 @@ void Slab_cache::free(void* ptr)
         }
     }
 }
+
+void Slab_cache::free_bulk(void* const* objs, size_t n)
+{
+    Lock_guard<Spinlock> guard(lock);
+
+    for (size_t i = 0; i < n; i++) {
+        free_locked(objs[i]);
+    }
+}
+
+void Slab_cache::free(void* ptr)
+{
+    if (EXPECT_TRUE(has_magazine())) {
+        magazines()[magazine].free(*this, ptr);
+    } else {
+        Lock_guard<Spinlock> guard(lock);
+        free_locked(ptr);
+    }
+}
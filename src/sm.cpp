@@ -25,7 +25,70 @@ INIT_PRIORITY(PRIO_SLAB)
 Slab_cache Sm::cache(sizeof(Sm), 32);
 
 Sm::Sm(Pd* own, mword sel, mword cnt, Sm* s, mword v)
-    : Typed_kobject(static_cast<Space_obj*>(own), sel, Sm::PERM_ALL, free), Si(s, v), counter(cnt)
+    : Typed_kobject(static_cast<Space_obj*>(own), sel, Sm::PERM_ALL, free, pre_free), Si(s, v), counter(cnt)
 {
     trace(TRACE_SYSCALL, "SM:%p created (CNT:%lu)", this, cnt);
 }
+
+Sm::Sm(Pd* own, mword sel, long cnt, mword user_page)
+    : Typed_kobject(static_cast<Space_obj*>(own), sel, Sm::PERM_ALL, free, pre_free), Si(nullptr, 0),
+      counter(0), shared(static_cast<long*>(Buddy::allocator.alloc(0, Buddy::FILL_0)))
+{
+    *shared = cnt;
+
+    bool ok = own->add_ref();
+    assert(ok);
+
+    if (ok) {
+        shared_pd = own;
+        shared_addr = user_page;
+
+        shared_pd->Space_mem::insert(shared_addr, 0,
+                                     Hpt::PTE_NODELEG | Hpt::PTE_NX | Hpt::PTE_U | Hpt::PTE_W | Hpt::PTE_P,
+                                     Buddy::ptr_to_phys(shared));
+    }
+
+    trace(TRACE_SYSCALL, "SM:%p created (CNT:%ld UPAGE:%#lx)", this, cnt, user_page);
+}
+
+Sm::~Sm()
+{
+    pre_free(this);
+
+    if (shared_pd and shared_pd->del_rcu())
+        Rcu::call(shared_pd);
+
+    // Waiters are released with an error below and the counter is gone for
+    // userspace, so its value does not matter anymore. Userspace may still
+    // write to it through stale TLB entries, so the page can only be reused
+    // after the TLB shootdown that pre_free() requested.
+    if (shared) {
+        Pd::free_page_after_flush(shared);
+        shared = nullptr;
+    }
+
+    while (!counter)
+        up(Ec::sys_finish<Sys_regs::BAD_CAP, true>);
+}
+
+void Sm::pre_free(Rcu_elem* a)
+{
+    Sm* sm = static_cast<Sm*>(a);
+
+    // Cleanup the user space mapping of the shared counter.
+    if (sm->shared_addr) {
+        Pd* pd = sm->shared_pd;
+        Tlb_cleanup cleanup{pd->Space_mem::remove(sm->shared_addr, 0)};
+
+        if (cleanup.need_tlb_flush())
+            pd->stale_host_tlb.merge(pd->cpus);
+
+        // Removing a single page does not free page tables. The shootdown
+        // happens before the destructor frees the counter page. See
+        // Pd::free_page_after_flush().
+        assert(not cleanup.has_pages());
+        cleanup.ignore_tlb_flush();
+
+        sm->shared_addr = 0;
+    }
+}
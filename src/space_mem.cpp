@@ -18,6 +18,7 @@
  * GNU General Public License version 2 for more details.
  */
 
+#include "bit_range.hpp"
 #include "counter.hpp"
 #include "dmar.hpp"
 #include "hazards.hpp"
@@ -28,10 +29,12 @@
 #include "pd.hpp"
 #include "space.hpp"
 #include "stdio.hpp"
+#include "string.hpp"
 #include "svm.hpp"
 #include "vectors.hpp"
 
 unsigned Space_mem::did_ctr;
+uint64 Space_mem::pcid_tag_ctr;
 
 void Space_mem::init(unsigned cpu) { cpus.set(cpu); }
 
@@ -43,11 +46,11 @@ static bool is_valid_user_mapping(mword vaddr, mword ord)
 }
 
 // Find the source mapping at snd_cur in the given position.
-static Hpt::Mapping lookup_and_adjust_rights(Space_mem* snd, mword snd_cur, mword snd_end, mword hw_attr)
+static Hpt::Mapping lookup_and_adjust_rights(Hpt::Cursor& snd, mword snd_cur, mword snd_end, mword hw_attr)
 {
     bool const is_unmap{(hw_attr & Hpt::PTE_P) == 0};
     Hpt::Mapping const empty_mapping{snd_cur, 0, 0, static_cast<Hpt::ord_t>(max_order(snd_cur, snd_end))};
-    Hpt::Mapping mapping{is_unmap ? empty_mapping : snd->Space_mem::hpt.lookup(snd_cur)};
+    Hpt::Mapping mapping{is_unmap ? empty_mapping : snd.lookup(snd_cur)};
 
     if (mapping.present() and ((mapping.attr & Hpt::PTE_NODELEG) or not(mapping.attr & Hpt::PTE_U))) {
         trace(TRACE_ERROR, "Refusing to map region %#016lx ord %d", mapping.vaddr, mapping.order);
@@ -58,6 +61,103 @@ static Hpt::Mapping lookup_and_adjust_rights(Space_mem* snd, mword snd_cur, mwor
     return mapping;
 }
 
+// The source and destination of a delegation.
+struct Send_window {
+    mword snd_base;
+    mword rcv_base;
+    mword ord;
+    Hpt::pte_t hw_attr;
+
+    mword snd_end() const { return snd_base + (1ULL << ord); }
+};
+
+// Return the mapping that the send window contains at snd_cur as it goes into
+// the destination page tables and advance snd_cur past it.
+NOINLINE static Hpt::Mapping next_target(Hpt::Cursor& snd_cursor, mword& snd_cur, Send_window const& w)
+{
+    // The source mapping with the correct downgraded rights.
+    auto const mapping{lookup_and_adjust_rights(snd_cursor, snd_cur, w.snd_end(), w.hw_attr)};
+
+    // The source mapping chopped down to fit in the send window.
+    auto const clamped{mapping.clamp(w.snd_base, static_cast<Hpt::ord_t>(w.ord))};
+
+    // The mapping as we want to put it into the destination page tables.
+    auto const target_mapping{clamped.move_by(w.rcv_base - w.snd_base)};
+    assert(Hpt::attr_to_pat(target_mapping.attr) == 0);
+
+    assert(clamped.size() >= target_mapping.size());
+    snd_cur = clamped.vaddr + target_mapping.size();
+
+    return target_mapping;
+}
+
+// Write a mapping into a destination page table of a delegation. This is
+// kept out of line to keep the stack frame of copy_send_window() small.
+template <typename CURSOR, typename CONVERT>
+NOINLINE static void update_target(CURSOR& cursor, Tlb_cleanup& cleanup, CONVERT const& convert,
+                                   Hpt::Mapping const& mapping, bool promote)
+{
+    cursor.update(cleanup, convert(mapping));
+
+    if (promote) {
+        cursor.promote(cleanup, mapping.vaddr);
+    }
+}
+
+// Write a mapping into a guest page table of a delegation. Promotion must
+// not race with other updates of the guest page tables, so we hold
+// guest_lock. Page tables may have been replaced while we did not hold it,
+// so the cursor starts again at the root.
+template <typename CURSOR, typename CONVERT>
+NOINLINE static void update_guest_target(Space_mem* rcv, CURSOR& cursor, Tlb_cleanup& cleanup,
+                                         CONVERT const& convert, Hpt::Mapping const& mapping)
+{
+    Lock_guard<Spinlock> guard(rcv->guest_lock);
+
+    cursor.reset();
+    update_target(cursor, cleanup, convert, mapping, true);
+}
+
+// Copy the mappings of the send window into the page tables of the given
+// subspaces of rcv.
+//
+// The send window is walked only once. Each source mapping is written into
+// all destination page tables before we move on to the next one. The host
+// and DMA page tables are walked with a cursor, so each page table on the
+// way is only visited once. Guest page tables are walked from the root for
+// each mapping, because we hold guest_lock only while we update them. They
+// are merged back into superpages where possible, because guests populate
+// their memory in small pieces.
+//
+// Updates of the DMA page table go to dev_cleanup, all others to cleanup.
+template <typename GUEST_PT, typename GUEST_CONVERT>
+NOINLINE static void copy_send_window(Tlb_cleanup& cleanup, Tlb_cleanup& dev_cleanup, Space_mem* rcv,
+                                      GUEST_PT& guest_pt, GUEST_CONVERT const& guest_convert, Space_mem* snd,
+                                      Send_window const& w, mword sub)
+{
+    Hpt::Cursor snd_cursor{snd->hpt};
+    Dpt::Cursor dpt_cursor{rcv->dpt};
+    typename GUEST_PT::Cursor guest_cursor{guest_pt};
+    Hpt::Cursor hpt_cursor{rcv->hpt};
+
+    auto const as_is = [](Hpt::Mapping const& m) { return m; };
+    for (mword snd_cur{w.snd_base}; snd_cur < w.snd_end();) {
+        auto const target_mapping{next_target(snd_cursor, snd_cur, w)};
+
+        if (sub & Space::SUBSPACE_DEVICE) {
+            update_target(dpt_cursor, dev_cleanup, Dpt::convert_mapping, target_mapping, false);
+        }
+
+        if (sub & Space::SUBSPACE_GUEST) {
+            update_guest_target(rcv, guest_cursor, cleanup, guest_convert, target_mapping);
+        }
+
+        if (sub & Space::SUBSPACE_HOST) {
+            update_target(hpt_cursor, cleanup, as_is, target_mapping, false);
+        }
+    }
+}
+
 // Addresses are in byte-granularity.
 Tlb_cleanup Space_mem::delegate(Space_mem* snd, mword snd_base, mword rcv_base, mword ord, mword attr,
                                 mword sub)
@@ -73,50 +173,31 @@ Tlb_cleanup Space_mem::delegate(Space_mem* snd, mword snd_base, mword rcv_base,
     }
 
     Hpt::pte_t const hw_attr{Hpt::hw_attr(attr)};
-    mword const snd_end{snd_base + (1ULL << ord)};
+    auto const as_is = [](Hpt::Mapping const& m) { return m; };
 
-    for (mword snd_cur{snd_base}; snd_cur < snd_end;) {
-        // The source mapping with the correct downgraded rights.
-        auto const mapping{lookup_and_adjust_rights(snd, snd_cur, snd_end, hw_attr)};
+    Send_window const window{snd_base, rcv_base, ord, hw_attr};
+    Tlb_cleanup dev_cleanup;
 
-        // The source mapping chopped down to fit in the send window.
-        auto const clamped{mapping.clamp(snd_base, static_cast<Hpt::ord_t>(ord))};
-
-        // The mapping as we want to put it into the destination page tables.
-        auto const target_mapping{clamped.move_by(rcv_base - snd_base)};
-        assert(Hpt::attr_to_pat(target_mapping.attr) == 0);
-
-        if (sub & Space::SUBSPACE_DEVICE) {
-            dpt.update(cleanup, Dpt::convert_mapping(target_mapping));
-
-            // We would only want to call `cleanup.flush_tlb_later();` explicitly if the Caching
-            // Mode of the IOMMU is set to 1, which implies that even non-present and erroneus
-            // mappings may be cached. For all other cases the generic_page_table code should
-            // already call `flush_tlb_later()` when necessary. We cannot easily access this
-            // information here, which is why we always explicitly kick off the flush.
-            cleanup.flush_tlb_later();
-        }
-
-        if (sub & Space::SUBSPACE_GUEST) {
-            if (Vmcb::has_npt()) {
-                npt.update(cleanup, target_mapping);
-            } else {
-                ept.update(cleanup, Ept::convert_mapping(target_mapping));
-            }
-        }
+    if (Vmcb::has_npt()) {
+        copy_send_window(cleanup, dev_cleanup, this, npt, as_is, snd, window, sub);
+    } else {
+        copy_send_window(cleanup, dev_cleanup, this, ept, Ept::convert_mapping, snd, window, sub);
+    }
 
-        if (sub & Space::SUBSPACE_HOST) {
-            hpt.update(cleanup, target_mapping);
+    if (sub & Space::SUBSPACE_DEVICE) {
+        // With Caching Mode, the IOMMU may also cache non-present entries,
+        // so new mappings need a flush as well.
+        if (dev_cleanup.need_tlb_flush() or Dmar::caching_mode()) {
+            Dmar::flush_tlb(did, rcv_base, ord);
         }
 
-        assert(clamped.size() >= target_mapping.size());
-        snd_cur = clamped.vaddr + target_mapping.size();
+        // The IOTLB flush has completed, so page tables that were removed
+        // from the DMA page tables only wait for the CPU TLB flush, if any.
+        dev_cleanup.ignore_tlb_flush();
+        cleanup.merge(dev_cleanup);
     }
 
     if (cleanup.need_tlb_flush()) {
-        if (sub & Space::SUBSPACE_DEVICE) {
-            Dmar::flush_all_contexts();
-        }
         if (sub & Space::SUBSPACE_GUEST) {
             stale_guest_tlb.merge(cpus);
         }
@@ -128,6 +209,49 @@ Tlb_cleanup Space_mem::delegate(Space_mem* snd, mword snd_base, mword rcv_base,
     return cleanup;
 }
 
+bool Space_mem::has_guest_dirty_bits()
+{
+    // The nested page tables of SVM always have dirty bits.
+    return (Hip::feature() & Hip::FEAT_SVM) or ((Hip::feature() & Hip::FEAT_VMX) and Ept::has_ad_bits());
+}
+
+mword Space_mem::guest_end() const
+{
+    return 1ULL << (Vmcb::has_npt() ? npt.max_order() : ept.max_order());
+}
+
+Tlb_cleanup Space_mem::harvest_dirty(mword gpa, mword pages, mword* bitmap)
+{
+    Tlb_cleanup cleanup;
+
+    assert(has_guest_dirty_bits());
+
+    mword const end{gpa + pages * PAGE_SIZE};
+
+    memset(bitmap, 0, align_up(pages, sizeof(mword) * 8) / 8);
+
+    auto const mark = [gpa, end, bitmap](auto const& m) {
+        mword const first{max<mword>(m.vaddr, gpa)};
+        mword const last{min<mword>(m.vaddr + m.size(), end)};
+
+        update_bit_range(bitmap, (first - gpa) / PAGE_SIZE, (last - first) / PAGE_SIZE, true);
+    };
+
+    Lock_guard<Spinlock> guard(guest_lock);
+
+    if (Vmcb::has_npt()) {
+        npt.clear_dirty(cleanup, gpa, end, mark);
+    } else {
+        ept.clear_dirty(cleanup, gpa, end, mark);
+    }
+
+    if (cleanup.need_tlb_flush()) {
+        stale_guest_tlb.merge(cpus);
+    }
+
+    return cleanup;
+}
+
 Tlb_cleanup Space_mem::revoke(mword vaddr, mword ord, mword attr)
 {
     auto const all_mem_rights{Mdb::MEM_R | Mdb::MEM_W | Mdb::MEM_X};
@@ -144,11 +268,19 @@ Tlb_cleanup Space_mem::revoke(mword vaddr, mword ord, mword attr)
 
 void Space_mem::shootdown()
 {
+    Cpuset targets;
+    unsigned num_targets{0}, num_remote{0};
+
+    // Sample the acknowledgement counters of all CPUs that need a flush
+    // before we send any IPI. Otherwise, we might miss an acknowledgement.
     for (unsigned cpu = 0; cpu < NUM_CPU; cpu++) {
 
         if (!Hip::cpu_online(cpu))
             continue;
 
+        if (Cpu::id() != cpu)
+            num_remote++;
+
         Pd* pd = Pd::remote(cpu);
 
         if (!pd->stale_host_tlb.chk(cpu) && !pd->stale_guest_tlb.chk(cpu))
@@ -159,17 +291,33 @@ void Space_mem::shootdown()
             continue;
         }
 
-        unsigned ctr = Counter::remote_tlb_shootdown(cpu);
+        shootdown_ctr()[cpu] = Counter::remote_tlb_shootdown(cpu);
+        targets.set(cpu);
+        num_targets++;
+    }
+
+    if (num_targets == 0)
+        return;
 
-        Lapic::send_ipi(cpu, VEC_IPI_RKE);
+    // If every other CPU needs to be interrupted anyway, a single broadcast
+    // IPI is cheaper than sending one IPI per CPU. CPUs without stale TLB
+    // entries just acknowledge the IPI, so this is also safe when the
+    // current PDs of remote CPUs changed in the meantime.
+    if (num_targets == num_remote)
+        Lapic::send_ipi_all_but_self(VEC_IPI_RKE);
+    else
+        for (unsigned cpu = 0; cpu < NUM_CPU; cpu++)
+            if (targets.chk(cpu))
+                Lapic::send_ipi(cpu, VEC_IPI_RKE);
 
-        asm volatile("sti" : : : "memory");
+    asm volatile("sti" : : : "memory");
 
-        while (Counter::remote_tlb_shootdown(cpu) == ctr)
-            pause();
+    for (unsigned cpu = 0; cpu < NUM_CPU; cpu++)
+        if (targets.chk(cpu))
+            while (Counter::remote_tlb_shootdown(cpu) == shootdown_ctr()[cpu])
+                pause();
 
-        asm volatile("cli" : : : "memory");
-    }
+    asm volatile("cli" : : : "memory");
 }
 
 static void map_typed_range(Hpt& hpt, Paddr start, Paddr end, Hpt::pte_t attr, unsigned t)
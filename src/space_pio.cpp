@@ -19,40 +19,81 @@
  */
 
 #include "assert.hpp"
+#include "bit_range.hpp"
 #include "lock_guard.hpp"
 #include "pd.hpp"
 
-Space_pio::Space_pio(Space_mem* mem)
+Space_pio::Space_pio(Space_mem* space_mem) : hbmp{0}, gbmp{0}, mem{space_mem}
 {
     assert(mem);
 
-    hbmp = Buddy::ptr_to_phys(Buddy::allocator.alloc(1, Buddy::FILL_1));
-    gbmp = Buddy::ptr_to_phys(Buddy::allocator.alloc(1, Buddy::FILL_1));
-
     // This mapping of the IO Permission Bitmap is only used by the CPU to do access control. Map it
     // read-only.
-    mem->insert(SPC_LOCAL_IOP, 1, Hpt::PTE_NX | Hpt::PTE_A | Hpt::PTE_P, hbmp);
+    mem->insert(SPC_LOCAL_IOP, 1, Hpt::PTE_NX | Hpt::PTE_A | Hpt::PTE_P, deny_all_bmp());
 }
 
 Space_pio::~Space_pio()
 {
-    Buddy::allocator.free(reinterpret_cast<mword>(Buddy::phys_to_ptr(gbmp)));
-    Buddy::allocator.free(reinterpret_cast<mword>(Buddy::phys_to_ptr(hbmp)));
+    if (gbmp)
+        Buddy::allocator.free(reinterpret_cast<mword>(Buddy::phys_to_ptr(gbmp)));
+
+    if (hbmp)
+        Buddy::allocator.free(reinterpret_cast<mword>(Buddy::phys_to_ptr(hbmp)));
+}
+
+Paddr Space_pio::deny_all_bmp()
+{
+    // The first PD is created during boot before any other CPU runs, so there is no race here.
+    static Paddr const bmp{Buddy::ptr_to_phys(Buddy::allocator.alloc(1, Buddy::FILL_1))};
+
+    return bmp;
+}
+
+Paddr Space_pio::bmp(bool host, bool& tlb_flush)
+{
+    Paddr& slot{host ? hbmp : gbmp};
+
+    if (Paddr const b{Atomic::load(slot)}; EXPECT_TRUE(b))
+        return b;
+
+    Lock_guard<Spinlock> guard(bmp_lock);
+
+    if (not slot) {
+        Paddr const new_bmp{Buddy::ptr_to_phys(Buddy::allocator.alloc(1, Buddy::FILL_1))};
+
+        if (host) {
+            // Replace the shared bitmap. CPUs that currently run this PD may still use the old mapping.
+            mem->insert(SPC_LOCAL_IOP, 1, Hpt::PTE_NX | Hpt::PTE_A | Hpt::PTE_P, new_bmp);
+            mem->stale_host_tlb.merge(mem->cpus);
+        }
+
+        Atomic::store(slot, new_bmp);
+    }
+
+    // If someone else was faster, their TLB shootdown may still be in
+    // progress. We flush as well, before our caller relies on the new host
+    // bitmap.
+    tlb_flush |= host;
+
+    return slot;
 }
 
 Paddr Space_pio::walk(bool host, mword idx)
 {
-    return (host ? hbmp : gbmp) | (idx_to_virt(idx) & (2 * PAGE_SIZE - 1));
+    bool tlb_flush{false};
+    Paddr const b{bmp(host, tlb_flush)};
+
+    // Only the guest bitmap is handed out this way. It is never mapped.
+    assert(not tlb_flush);
+
+    return b | (idx_to_virt(idx) & (2 * PAGE_SIZE - 1));
 }
 
-void Space_pio::update(bool host, mword idx, mword attr)
+void Space_pio::update(Paddr bmp, mword idx, mword count, bool deny)
 {
-    mword* m = static_cast<mword*>(Buddy::phys_to_ptr(walk(host, idx)));
+    assert(idx + count <= 2 * PAGE_SIZE * 8);
 
-    if (attr)
-        Atomic::clr_mask(*m, idx_to_mask(idx));
-    else
-        Atomic::set_mask(*m, idx_to_mask(idx));
+    update_bit_range(static_cast<mword*>(Buddy::phys_to_ptr(bmp)), idx, count, deny);
 }
 
 Tlb_cleanup Space_pio::update(Mdb* mdb, mword r)
@@ -61,15 +102,20 @@ Tlb_cleanup Space_pio::update(Mdb* mdb, mword r)
 
     Lock_guard<Spinlock> guard(mdb->node_lock);
 
-    for (unsigned long i = 0; i < (1UL << mdb->node_order); i++) {
-        if (mdb->node_sub & SUBSPACE_HOST) {
-            update(true, mdb->node_base + i, mdb->node_attr & ~r);
-        }
+    bool tlb_flush{false};
+    Paddr const host_bmp{mdb->node_sub & SUBSPACE_HOST ? bmp(true, tlb_flush) : 0};
+    Paddr const guest_bmp{mdb->node_sub & SUBSPACE_GUEST ? bmp(false, tlb_flush) : 0};
 
-        if (mdb->node_sub & SUBSPACE_GUEST) {
-            update(false, mdb->node_base + i, mdb->node_attr & ~r);
-        }
+    // Set bits deny access to their port.
+    bool const deny{not(mdb->node_attr & ~r)};
+
+    if (host_bmp) {
+        update(host_bmp, mdb->node_base, 1UL << mdb->node_order, deny);
+    }
+
+    if (guest_bmp) {
+        update(guest_bmp, mdb->node_base, 1UL << mdb->node_order, deny);
     }
 
-    return {};
+    return Tlb_cleanup::tlb_flush(tlb_flush);
 }
@@ -27,4 +27,7 @@ USED void* memmove(void* d, void const* s, size_t n) { return impl_memmove(d, s,
 
 USED void* memset(void* d, int c, size_t n) { return impl_memset(d, c, n); }
 
+void* memzero_stosq(void* d, size_t n) { return impl_memzero_stosq(d, n); }
+void* memzero_nt(void* d, size_t n) { return impl_memzero_nt(d, n); }
+
 bool strnmatch(char const* s1, char const* s2, size_t n) { return impl_strnmatch(s1, s2, n); }
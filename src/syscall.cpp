@@ -24,6 +24,7 @@
 
 #include "syscall.hpp"
 #include "acpi.hpp"
+#include "counter.hpp"
 #include "dmar.hpp"
 #include "gsi.hpp"
 #include "hip.hpp"
@@ -35,30 +36,34 @@
 #include "sm.hpp"
 #include "stdio.hpp"
 #include "suspend.hpp"
+#include "trace.hpp"
 #include "utcb.hpp"
 #include "vectors.hpp"
 
 template <Sys_regs::Status S, bool T> void Ec::sys_finish()
 {
-    if (EXPECT_FALSE(S != Sys_regs::SUCCESS)) {
-        trace(TRACE_FAILED_SYSCALL, "hypercall error %d", S);
-    }
-
     if (T)
         current()->clr_timeout();
 
-    current()->regs.set_status(S);
+    sys_finish(S);
+}
+
+void Ec::sys_finish(Sys_regs::Status status)
+{
+    if (EXPECT_FALSE(status != Sys_regs::SUCCESS)) {
+        trace(TRACE_FAILED_SYSCALL, "hypercall error %d", status);
+    }
+
+    current()->regs.set_status(status);
 
     ret_user_sysexit();
 }
 
 void Ec::activate()
 {
-    Ec* ec = this;
+    Ec* ec = chain_root->chain_tail;
 
-    // XXX: Make the loop preemptible
-    for (Sc::ctr_link() = 0; ec->partner; ec = ec->partner)
-        Sc::ctr_link()++;
+    Sc::ctr_link() = ec->chain_depth - chain_depth;
 
     if (EXPECT_FALSE(ec->blocked()))
         ec->block_sc();
@@ -123,8 +128,20 @@ void Ec::sys_call()
 
     Ec* ec = pt->ec;
 
-    if (EXPECT_FALSE(current()->cpu != ec->xcpu))
-        sys_finish<Sys_regs::BAD_CPU>();
+    if (EXPECT_FALSE(current()->cpu != ec->xcpu)) {
+        // We cannot tell whether the remote handler is busy without waiting
+        // for it.
+        if (EXPECT_FALSE(s->flags() & Sys_call::DISABLE_BLOCKING))
+            sys_finish<Sys_regs::BAD_CPU>();
+
+        // The proxy of this CPU is busy with our own call chain. If the
+        // callee called back into this CPU, the two proxies would wait for
+        // each other forever.
+        if (EXPECT_FALSE(current()->chain_root == xcall_proxy()))
+            sys_finish<Sys_regs::BAD_CPU>();
+
+        send_xcall(pt);
+    }
 
     if (EXPECT_TRUE(!ec->cont)) {
         current()->cont = ret_user_sysexit;
@@ -184,6 +201,9 @@ void Ec::reply(void (*c)(), Sm* sm)
     if (EXPECT_FALSE(!ec))
         Sc::current()->ec->activate();
 
+    if (EXPECT_FALSE(ec->xcall.waiting))
+        xcall_reply();
+
     bool clr = ec->clr_partner();
 
     if (Sc::current()->ec == ec && Sc::current()->last_ref())
@@ -208,6 +228,11 @@ void Ec::sys_reply()
         if (EXPECT_FALSE(r->sm())) {
             sm = capability_cast<Sm>(Space_obj::lookup(r->sm()));
 
+            // A caller on another CPU cannot be blocked on a semaphore from
+            // here, so the semaphore is ignored for cross-CPU calls.
+            if (sm and ec->xcall.waiting)
+                sm = nullptr;
+
             if (sm and ec->cont == ret_user_sysexit) {
                 ec->cont = sys_call;
             }
@@ -356,7 +381,7 @@ void Ec::sys_create_sc()
     sys_finish<Sys_regs::SUCCESS>();
 }
 
-void Ec::sys_create_pt()
+Sys_regs::Status Ec::do_create_pt()
 {
     Sys_create_pt* r = static_cast<Sys_create_pt*>(current()->sys_regs());
 
@@ -365,32 +390,34 @@ void Ec::sys_create_pt()
     if (Pd* pd_parent = capability_cast<Pd>(Space_obj::lookup(r->pd()), Pd::PERM_OBJ_CREATION);
         EXPECT_FALSE(not pd_parent)) {
         trace(TRACE_ERROR, "%s: Non-PD CAP (%#lx)", __func__, r->pd());
-        sys_finish<Sys_regs::BAD_CAP>();
+        return Sys_regs::BAD_CAP;
     }
 
     Ec* ec = capability_cast<Ec>(Space_obj::lookup(r->ec()), Ec::PERM_CREATE_PT);
 
     if (EXPECT_FALSE(not ec)) {
         trace(TRACE_ERROR, "%s: Non-EC CAP (%#lx)", __func__, r->ec());
-        sys_finish<Sys_regs::BAD_CAP>();
+        return Sys_regs::BAD_CAP;
     }
 
     if (EXPECT_FALSE(ec->glb)) {
         trace(TRACE_ERROR, "%s: Cannot bind PT", __func__);
-        sys_finish<Sys_regs::BAD_CAP>();
+        return Sys_regs::BAD_CAP;
     }
 
     Pt* pt = new Pt(Pd::current(), r->sel(), ec, r->mtd(), r->eip());
     if (!Space_obj::insert_root(pt)) {
         trace(TRACE_ERROR, "%s: Non-NULL CAP (%#lx)", __func__, r->sel());
         delete pt;
-        sys_finish<Sys_regs::BAD_CAP>();
+        return Sys_regs::BAD_CAP;
     }
 
-    sys_finish<Sys_regs::SUCCESS>();
+    return Sys_regs::SUCCESS;
 }
 
-void Ec::sys_create_sm()
+void Ec::sys_create_pt() { sys_finish(do_create_pt()); }
+
+Sys_regs::Status Ec::do_create_sm()
 {
     Sys_create_sm* r = static_cast<Sys_create_sm*>(current()->sys_regs());
 
@@ -399,7 +426,7 @@ void Ec::sys_create_sm()
     if (Pd* pd_parent = capability_cast<Pd>(Space_obj::lookup(r->pd()), Pd::PERM_OBJ_CREATION);
         EXPECT_FALSE(not pd_parent)) {
         trace(TRACE_ERROR, "%s: Non-PD CAP (%#lx)", __func__, r->pd());
-        sys_finish<Sys_regs::BAD_CAP>();
+        return Sys_regs::BAD_CAP;
     }
 
     Sm* sm;
@@ -409,29 +436,44 @@ void Ec::sys_create_sm()
 
         if (EXPECT_FALSE(not si)) {
             trace(TRACE_ERROR, "%s: Non-SM CAP (%#lx)", __func__, r->sm());
-            sys_finish<Sys_regs::BAD_CAP>();
+            return Sys_regs::BAD_CAP;
         }
 
         if (si->is_signal()) {
             /* limit chaining to solely one level */
             trace(TRACE_ERROR, "%s: SM CAP (%#lx) is signal", __func__, r->sm());
-            sys_finish<Sys_regs::BAD_CAP>();
+            return Sys_regs::BAD_CAP;
+        }
+
+        if (EXPECT_FALSE(si->has_shared_counter() or r->shared_counter())) {
+            trace(TRACE_ERROR, "%s: Signals and shared counters do not mix", __func__);
+            return Sys_regs::BAD_PAR;
         }
 
         sm = new Sm(Pd::current(), r->sel(), 0, si, r->cnt());
+    } else if (r->shared_counter()) {
+        if (EXPECT_FALSE(not r->user_page() or r->user_page() >= USER_ADDR or r->user_page() & PAGE_MASK or
+                         static_cast<long>(r->cnt()) < 0)) {
+            trace(TRACE_ERROR, "%s: Invalid UPAGE address (%#lx) or count", __func__, r->user_page());
+            return Sys_regs::BAD_PAR;
+        }
+
+        sm = new Sm(Pd::current(), r->sel(), static_cast<long>(r->cnt()), r->user_page());
     } else
         sm = new Sm(Pd::current(), r->sel(), r->cnt());
 
     if (!Space_obj::insert_root(sm)) {
         trace(TRACE_ERROR, "%s: Non-NULL CAP (%#lx)", __func__, r->sel());
         delete sm;
-        sys_finish<Sys_regs::BAD_CAP>();
+        return Sys_regs::BAD_CAP;
     }
 
-    sys_finish<Sys_regs::SUCCESS>();
+    return Sys_regs::SUCCESS;
 }
 
-void Ec::sys_revoke()
+void Ec::sys_create_sm() { sys_finish(do_create_sm()); }
+
+Sys_regs::Status Ec::do_revoke(Tlb_cleanup& cleanup)
 {
     Sys_revoke* r = static_cast<Sys_revoke*>(current()->sys_regs());
 
@@ -444,11 +486,11 @@ void Ec::sys_revoke()
 
         if (EXPECT_FALSE(not pd or not pd->add_ref())) {
             trace(TRACE_ERROR, "%s: Bad PD CAP (%#lx)", __func__, r->pd());
-            sys_finish<Sys_regs::BAD_CAP>();
+            return Sys_regs::BAD_CAP;
         }
     }
 
-    pd->rev_crd(r->crd(), r->self());
+    pd->rev_crd(r->crd(), r->self(), cleanup);
 
     if (r->remote() && pd->del_rcu())
         Rcu::call(pd);
@@ -459,7 +501,16 @@ void Ec::sys_revoke()
         }
     }
 
-    sys_finish<Sys_regs::SUCCESS>();
+    return Sys_regs::SUCCESS;
+}
+
+void Ec::sys_revoke()
+{
+    Tlb_cleanup cleanup;
+    Sys_regs::Status const status{do_revoke(cleanup)};
+
+    Pd::flush_cleanup(cleanup);
+    sys_finish(status);
 }
 
 void Ec::sys_pd_ctrl_lookup()
@@ -500,17 +551,20 @@ void Ec::sys_pd_ctrl_map_access_page()
 
     mword access_addr_phys = Buddy::ptr_to_phys(access_addr);
 
-    auto cleanup{pd->ept.update({crd.base() << PAGE_BITS, access_addr_phys,
-                                 Ept::PTE_R | Ept::PTE_W | Ept::PTE_I | (6 /* WB */ << Ept::PTE_MT_SHIFT),
-                                 PAGE_BITS})};
+    {
+        Lock_guard<Spinlock> guard(pd->guest_lock);
+        auto cleanup{pd->ept.update({crd.base() << PAGE_BITS, access_addr_phys,
+                                     Ept::PTE_R | Ept::PTE_W | Ept::PTE_I | (6 /* WB */ << Ept::PTE_MT_SHIFT),
+                                     PAGE_BITS})};
 
-    // XXX Check whether TLB needs to be invalidated.
-    cleanup.ignore_tlb_flush();
+        // XXX Check whether TLB needs to be invalidated.
+        cleanup.ignore_tlb_flush();
+    }
 
     sys_finish<Sys_regs::SUCCESS>();
 }
 
-void Ec::sys_pd_ctrl_delegate()
+Sys_regs::Status Ec::do_pd_ctrl_delegate(Tlb_cleanup& cleanup)
 {
     Sys_pd_ctrl_delegate* s = static_cast<Sys_pd_ctrl_delegate*>(current()->sys_regs());
     Xfer xfer = s->xfer();
@@ -523,12 +577,21 @@ void Ec::sys_pd_ctrl_delegate()
 
     if (EXPECT_FALSE(not(src_pd and dst_pd))) {
         trace(TRACE_ERROR, "%s: Bad PD CAP SRC:%#lx DST:%#lx", __func__, s->src_pd(), s->dst_pd());
-        sys_finish<Sys_regs::BAD_CAP>();
+        return Sys_regs::BAD_CAP;
     }
 
-    s->set_xfer(dst_pd->xfer_item(src_pd, s->dst_crd(), s->dst_crd(), xfer));
+    s->set_xfer(dst_pd->xfer_item(src_pd, s->dst_crd(), s->dst_crd(), xfer, cleanup));
 
-    sys_finish<Sys_regs::SUCCESS>();
+    return Sys_regs::SUCCESS;
+}
+
+void Ec::sys_pd_ctrl_delegate()
+{
+    Tlb_cleanup cleanup;
+    Sys_regs::Status const status{do_pd_ctrl_delegate(cleanup)};
+
+    Pd::flush_cleanup(cleanup);
+    sys_finish(status);
 }
 
 void Ec::sys_pd_ctrl_msr_access()
@@ -582,6 +645,17 @@ void Ec::sys_ec_ctrl()
 {
     Sys_ec_ctrl* r = static_cast<Sys_ec_ctrl*>(current()->sys_regs());
 
+    // Sets the recall hazard of an EC. Returns true, if the EC is running
+    // on another CPU that needs an IPI to notice the hazard.
+    auto const recall = [](Ec* ec) {
+        if (ec->regs.hazard() & HZD_RECALL)
+            return false;
+
+        ec->regs.set_hazard(HZD_RECALL);
+
+        return Cpu::id() != ec->cpu and Ec::remote(ec->cpu) == ec;
+    };
+
     switch (r->op()) {
     case Sys_ec_ctrl::RECALL: {
         Ec* ec = capability_cast<Ec>(Space_obj::lookup(r->ec()), Ec::PERM_EC_CTRL);
@@ -591,13 +665,42 @@ void Ec::sys_ec_ctrl()
             sys_finish<Sys_regs::BAD_CAP>();
         }
 
-        if (!(ec->regs.hazard() & HZD_RECALL)) {
+        if (recall(ec))
+            Lapic::send_ipi(ec->cpu, VEC_IPI_RKE);
+        break;
+    }
+
+    case Sys_ec_ctrl::RECALL_MANY: {
+        mword const mask{r->ec_mask()};
+
+        // Check all capabilities first, so a bad one does not leave the
+        // ECs before it recalled.
+        for (mword m{mask}; m; m &= m - 1) {
+            unsigned long const sel{r->ec() + static_cast<unsigned long>(bit_scan_forward(m))};
+
+            if (EXPECT_FALSE(not capability_cast<Ec>(Space_obj::lookup(sel), Ec::PERM_EC_CTRL))) {
+                trace(TRACE_ERROR, "%s: Bad EC CAP (%#lx)", __func__, sel);
+                sys_finish<Sys_regs::BAD_CAP>();
+            }
+        }
+
+        // Many vCPUs of a VM share few CPUs, so we send at most one IPI to
+        // each of them.
+        Cpuset targets;
 
-            ec->regs.set_hazard(HZD_RECALL);
+        for (mword m{mask}; m; m &= m - 1) {
+            unsigned long const sel{r->ec() + static_cast<unsigned long>(bit_scan_forward(m))};
 
-            if (Cpu::id() != ec->cpu && Ec::remote(ec->cpu) == ec)
-                Lapic::send_ipi(ec->cpu, VEC_IPI_RKE);
+            // The capability may have been revoked concurrently.
+            Ec* ec = capability_cast<Ec>(Space_obj::lookup(sel), Ec::PERM_EC_CTRL);
+
+            if (ec and recall(ec))
+                targets.set(ec->cpu);
         }
+
+        for (unsigned cpu = 0; cpu < NUM_CPU; cpu++)
+            if (targets.chk(cpu))
+                Lapic::send_ipi(cpu, VEC_IPI_RKE);
         break;
     }
 
@@ -664,6 +767,24 @@ void Ec::sys_sm_ctrl()
         if (sm->is_signal())
             sys_finish<Sys_regs::BAD_CAP>();
 
+        if (EXPECT_FALSE(r->zc() and sm->has_shared_counter()))
+            sys_finish<Sys_regs::BAD_PAR>();
+
+        if (r->drain()) {
+            if (EXPECT_FALSE(r->zc()))
+                sys_finish<Sys_regs::BAD_PAR>();
+
+            uint64 const time{r->time()};
+
+            // A zero count means that the down operation did not hand over
+            // a signal.
+            current()->set_si_regs(0, 0);
+            current()->cont = Ec::sys_sm_ctrl_drain;
+            sm->dn(false, time);
+
+            sys_sm_ctrl_drain();
+        }
+
         current()->cont = Ec::sys_finish<Sys_regs::SUCCESS, true>;
         sm->dn(r->zc(), r->time());
         break;
@@ -672,6 +793,36 @@ void Ec::sys_sm_ctrl()
     sys_finish<Sys_regs::SUCCESS>();
 }
 
+// Finish a draining down operation on a semaphore that signal semaphores
+// are chained to. This runs after the EC was woken up or, if it did not
+// block, directly from sys_sm_ctrl().
+void Ec::sys_sm_ctrl_drain()
+{
+    Ec* ec = current();
+    Sys_sm_ctrl* r = static_cast<Sys_sm_ctrl*>(ec->sys_regs());
+
+    mword* const pairs{&ec->utcb->mr(0)};
+    mword const max_pairs{Utcb::num_mr() / 2};
+    mword n{0};
+
+    ec->clr_timeout();
+
+    if (r->si_count()) {
+        pairs[0] = r->si_value();
+        pairs[1] = r->si_count();
+        n++;
+    }
+
+    // Collect all other signals that are ready by now. The capability may
+    // have been revoked while we were blocked.
+    if (Sm* sm = capability_cast<Sm>(Space_obj::lookup(r->sm()), Sm::PERM_DOWN); sm)
+        n += sm->drain(pairs + 2 * n, max_pairs - n);
+
+    r->set_drained(n);
+
+    sys_finish<Sys_regs::SUCCESS>();
+}
+
 void Ec::sys_assign_pci()
 {
     Sys_assign_pci* r = static_cast<Sys_assign_pci*>(current()->sys_regs());
@@ -774,6 +925,10 @@ void Ec::sys_machine_ctrl()
         sys_machine_ctrl_suspend();
     case Sys_machine_ctrl::UPDATE_MICROCODE:
         sys_machine_ctrl_update_microcode();
+    case Sys_machine_ctrl::READ_COUNTER:
+        sys_machine_ctrl_read_counter();
+    case Sys_machine_ctrl::TRACE:
+        sys_machine_ctrl_trace();
 
     default:
         sys_finish<Sys_regs::BAD_PAR>();
@@ -820,6 +975,164 @@ void Ec::sys_machine_ctrl_update_microcode()
     sys_finish<Sys_regs::SUCCESS>();
 }
 
+void Ec::sys_machine_ctrl_read_counter()
+{
+    Sys_machine_ctrl_read_counter* r = static_cast<Sys_machine_ctrl_read_counter*>(current()->sys_regs());
+
+    if (EXPECT_FALSE(r->counter() >= Counter::NUM_COUNTERS)) {
+        trace(TRACE_ERROR, "%s: Invalid counter (%#lx)", __func__, r->counter());
+        sys_finish<Sys_regs::BAD_PAR>();
+    }
+
+    if (EXPECT_FALSE(!Hip::cpu_online(r->cpu()))) {
+        trace(TRACE_ERROR, "%s: Invalid CPU (%#x)", __func__, r->cpu());
+        sys_finish<Sys_regs::BAD_CPU>();
+    }
+
+    r->set_value(Counter::remote_read(static_cast<Counter::Id>(r->counter()), r->cpu()));
+
+    sys_finish<Sys_regs::SUCCESS>();
+}
+
+void Ec::sys_machine_ctrl_trace()
+{
+    Sys_machine_ctrl_trace* r = static_cast<Sys_machine_ctrl_trace*>(current()->sys_regs());
+    Crd crd = r->crd();
+
+    if (crd.value() != 0) {
+        if (EXPECT_FALSE(crd.type() != Crd::MEM or crd.order() != Trace::RING_ORDER)) {
+            trace(TRACE_ERROR, "%s: Invalid trace ring CRD (%#lx)", __func__, crd.value());
+            sys_finish<Sys_regs::BAD_PAR>();
+        }
+
+        if (EXPECT_FALSE(!Hip::cpu_online(r->cpu()))) {
+            trace(TRACE_ERROR, "%s: Invalid CPU (%#x)", __func__, r->cpu());
+            sys_finish<Sys_regs::BAD_CPU>();
+        }
+
+        mword const ring_frame{Trace::ring_phys(r->cpu()) >> PAGE_BITS};
+
+        Tlb_cleanup cleanup{Pd::current()->delegate<Space_mem>(
+            &Pd::kern, ring_frame, crd.base(), Trace::RING_ORDER, Mdb::MEM_R, Space::SUBSPACE_HOST)};
+
+        if (cleanup.need_tlb_flush()) {
+            Pd::current()->shootdown();
+            cleanup.ignore_tlb_flush();
+            cleanup.free_pages_now();
+        }
+    }
+
+    r->set_old_mask(Trace::set_mask(r->mask()));
+
+    sys_finish<Sys_regs::SUCCESS>();
+}
+
+Sys_regs::Status Ec::do_multicall_op(Tlb_cleanup& cleanup)
+{
+    Sys_regs* r = current()->sys_regs();
+
+    switch (r->id()) {
+    case hypercall_id::HC_CREATE_PT:
+        return do_create_pt();
+    case hypercall_id::HC_CREATE_SM:
+        return do_create_sm();
+    case hypercall_id::HC_REVOKE:
+        return do_revoke(cleanup);
+    case hypercall_id::HC_PD_CTRL:
+        if (static_cast<Sys_pd_ctrl*>(r)->op() == Sys_pd_ctrl::DELEGATE) {
+            return do_pd_ctrl_delegate(cleanup);
+        }
+        break;
+    default:
+        break;
+    }
+
+    trace(TRACE_ERROR, "%s: Hypercall %d cannot be batched", __func__, static_cast<int>(r->id()));
+    return Sys_regs::BAD_HYP;
+}
+
+void Ec::sys_multicall()
+{
+    Sys_multicall* r = static_cast<Sys_multicall*>(current()->sys_regs());
+    Utcb* utcb = current()->utcb.get();
+    unsigned long const num_ops{r->num_ops()};
+
+    trace(TRACE_SYSCALL, "EC:%p SYS_MULTICALL OPS:%lu", current(), num_ops);
+
+    if (EXPECT_FALSE(num_ops > Utcb::num_mr() / Sys_multicall::OP_WORDS)) {
+        trace(TRACE_ERROR, "%s: Too many operations (%lu)", __func__, num_ops);
+        sys_finish<Sys_regs::BAD_PAR>();
+    }
+
+    // The operations run on the register state of the current EC as if they
+    // were called one by one. TLB shootdowns are collected and done once
+    // after the last operation. RCU callbacks are only queued by the
+    // operations, so they are processed once on the way back to userspace.
+    Tlb_cleanup cleanup;
+    unsigned long i = 0;
+
+    while (i < num_ops) {
+        mword* op = &utcb->mr(i * Sys_multicall::OP_WORDS);
+
+        r->load_op(op);
+        r->set_status(do_multicall_op(cleanup), false);
+        r->store_op(op);
+
+        if (++i == num_ops)
+            break;
+
+        // A batch can take long. Open a short interrupt window between the
+        // operations and stop early when the scheduler, RCU or a recall
+        // needs this CPU. Userspace submits the rest of the batch again.
+        asm volatile("sti; nop; cli" : : : "memory");
+
+        if (EXPECT_FALSE((Cpu::hazard() | current()->regs.hazard()) & (HZD_RECALL | HZD_RCU | HZD_SCHED)))
+            break;
+    }
+
+    Pd::flush_cleanup(cleanup);
+
+    r->set_num_done(i);
+    sys_finish<Sys_regs::SUCCESS>();
+}
+
+void Ec::sys_dirty_log()
+{
+    Sys_dirty_log* r = static_cast<Sys_dirty_log*>(current()->sys_regs());
+
+    trace(TRACE_SYSCALL, "EC:%p SYS_DIRTY_LOG PD:%#lx GPA:%#lx PAGES:%#lx", current(), r->pd(), r->gpa(),
+          r->pages());
+
+    Pd* pd = capability_cast<Pd>(Space_obj::lookup(r->pd()));
+
+    if (EXPECT_FALSE(not pd)) {
+        trace(TRACE_ERROR, "%s: Bad PD CAP (%#lx)", __func__, r->pd());
+        sys_finish<Sys_regs::BAD_CAP>();
+    }
+
+    if (EXPECT_FALSE(not Space_mem::has_guest_dirty_bits())) {
+        trace(TRACE_ERROR, "%s: No dirty bits in guest page tables", __func__);
+        sys_finish<Sys_regs::BAD_FTR>();
+    }
+
+    mword const max_pages{Utcb::num_mr() * sizeof(mword) * 8};
+
+    if (EXPECT_FALSE(r->gpa() & PAGE_MASK or r->pages() > max_pages or
+                     r->gpa() + r->pages() * PAGE_SIZE < r->gpa() or
+                     r->gpa() + r->pages() * PAGE_SIZE > pd->guest_end())) {
+        trace(TRACE_ERROR, "%s: Bad range (%#lx+%#lx)", __func__, r->gpa(), r->pages());
+        sys_finish<Sys_regs::BAD_PAR>();
+    }
+
+    // The dirty bits are only reported once all CPUs flushed their TLBs.
+    // Otherwise, a write that goes through a stale TLB entry after we
+    // return would not set the dirty bit again.
+    Tlb_cleanup cleanup{pd->harvest_dirty(r->gpa(), r->pages(), &current()->utcb->mr(0))};
+
+    Pd::flush_cleanup(cleanup);
+    sys_finish<Sys_regs::SUCCESS>();
+}
+
 void Ec::sys_foreign_syscall()
 {
     // base + CPU-Num equals correct PT. Userland must ensure, that the PTs are attached to
@@ -864,6 +1177,9 @@ void Ec::syscall_handler()
     }
     // else: handle as native system call
 
+    Trace::record(TRACE_SYSCALL, Trace::SYSCALL, current(), current()->sys_regs()->ARG_1,
+                  current()->sys_regs()->ARG_2, current()->sys_regs()->ARG_3);
+
     switch (current()->sys_regs()->id()) {
     case hypercall_id::HC_CALL:
         sys_call();
@@ -902,6 +1218,11 @@ void Ec::syscall_handler()
     case hypercall_id::HC_MACHINE_CTRL:
         sys_machine_ctrl();
 
+    case hypercall_id::HC_MULTICALL:
+        sys_multicall();
+    case hypercall_id::HC_DIRTY_LOG:
+        sys_dirty_log();
+
     default:
         trace(TRACE_FAILED_SYSCALL, "invalid hypercall %d", static_cast<int>(current()->sys_regs()->id()));
         Ec::sys_finish<Sys_regs::BAD_HYP>();
@@ -909,6 +1230,8 @@ void Ec::syscall_handler()
 }
 
 template void Ec::sys_finish<Sys_regs::COM_ABT>();
+template void Ec::sys_finish<Sys_regs::COM_TIM>();
+template void Ec::sys_finish<Sys_regs::BAD_CAP, true>();
 template void Ec::send_msg<Ec::ret_user_vmresume>();
 template void Ec::send_msg<Ec::ret_user_vmrun>();
 template void Ec::send_msg<Ec::ret_user_iret>();
@@ -22,67 +22,49 @@
 
 void Timeout::enqueue(uint64 t)
 {
-    assert(prev == nullptr);
-    assert(next == nullptr);
+    assert(!active());
 
-    time = t;
-
-    Timeout* p = nullptr;
+    Timeout* first = heap().min();
 
-    for (Timeout* n = list(); n; p = n, n = n->next)
-        if (n->time >= time)
-            break;
+    time = t;
 
-    prev = p;
+    heap().insert(this);
 
-    if (!p) {
-        next = list();
-        list() = this;
+    // The LAPIC only needs to know about the earliest deadline.
+    if (!first || time < first->time)
         Lapic::set_timer(time);
-    } else {
-        next = p->next;
-        p->next = this;
-    }
-
-    if (next)
-        next->prev = this;
 }
 
 uint64 Timeout::dequeue()
 {
     if (active()) {
+        bool was_first = heap().min() == this;
 
-        if (next)
-            next->prev = prev;
-
-        if (prev)
-            prev->next = next;
+        heap().remove(this);
 
-        else if ((list() = next))
-            Lapic::set_timer(list()->time);
+        if (was_first && heap().min() && heap().min()->time != time)
+            Lapic::set_timer(heap().min()->time);
     }
 
-    prev = next = nullptr;
-
     return time;
 }
 
 void Timeout::check()
 {
-    Timeout* prev_list = list();
+    Timeout* prev_first = heap().min();
 
-    while (list() && list()->time <= rdtsc()) {
-        Timeout* t = list();
+    while (heap().min() && heap().min()->time <= rdtsc()) {
+        Timeout* t = heap().min();
         t->dequeue();
         t->trigger();
     }
 
-    if (list() && (list() == prev_list)) {
+    if (heap().min() && (heap().min() == prev_first)) {
         /*
          * No timeout was dequeued, which can happen if the TSC stops in CPU
          * sleep states (non-invariant TSC). In that case, we program the
          * LAPIC again for the next timeout.
          */
-        Lapic::set_timer(list()->time);
+        Lapic::set_timer(heap().min()->time);
     }
 }
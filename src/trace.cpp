@@ -0,0 +1,40 @@
+/*
+ * Binary Event Tracing
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#include "trace.hpp"
+#include "buddy.hpp"
+
+unsigned Trace::mask;
+
+// The rings are naturally aligned, so each one can be mapped with a single
+// capability.
+alignas(TRACE_RING_PAGES * PAGE_SIZE) Trace::Ring Trace::rings[NUM_CPU];
+
+unsigned Trace::set_mask(unsigned new_mask)
+{
+    // Rings are initialized the first time tracing is enabled. Until then,
+    // nobody writes to them.
+    if (new_mask and not Atomic::load(mask)) {
+        for (auto& r : rings) {
+            if (not r.initialized()) {
+                r.init();
+            }
+        }
+    }
+
+    return Atomic::exchange(mask, new_mask);
+}
+
+Paddr Trace::ring_phys(unsigned cpu) { return Buddy::ptr_to_phys(&rings[cpu]); }
@@ -155,6 +155,10 @@ void Vmcs::init()
     auto const leaf_levels{static_cast<Ept::level_t>(bit_scan_reverse(leaf_bit_mask) + 1)};
     Ept::set_supported_leaf_levels(leaf_levels);
 
+    if (ept_vpid().ad) {
+        Ept::enable_ad_bits();
+    }
+
     fix_cr0_set() &= ~(Cpu::CR0_PG | Cpu::CR0_PE);
 
     fix_cr0_clr() |= Cpu::CR0_CD | Cpu::CR0_NW;
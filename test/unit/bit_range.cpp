@@ -0,0 +1,130 @@
+/*
+ * Bit Range Update Tests
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#include <bit_range.hpp>
+
+#include <random>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+namespace
+{
+
+constexpr size_t NUM_WORDS{8};
+constexpr size_t BITS_PER_WORD{sizeof(mword) * 8};
+constexpr size_t NUM_BITS{NUM_WORDS * BITS_PER_WORD};
+
+// The reference model: update the range one bit at a time.
+void update_bit_by_bit(std::vector<mword>& words, size_t first, size_t count, bool value)
+{
+    for (size_t i{first}; i < first + count; i++) {
+        mword const mask{1UL << (i % BITS_PER_WORD)};
+
+        if (value) {
+            words[i / BITS_PER_WORD] |= mask;
+        } else {
+            words[i / BITS_PER_WORD] &= ~mask;
+        }
+    }
+}
+
+} // anonymous namespace
+
+TEST_CASE("Empty bit ranges change nothing", "[bit_range]")
+{
+    std::vector<mword> words(NUM_WORDS, 0x5a5a5a5a5a5a5a5a);
+    auto const expected{words};
+
+    update_bit_range(words.data(), 17, 0, true);
+    update_bit_range(words.data(), 17, 0, false);
+
+    CHECK(words == expected);
+}
+
+TEST_CASE("Bit ranges are updated at word boundaries", "[bit_range]")
+{
+    std::vector<mword> words(NUM_WORDS, 0);
+
+    SECTION("A single bit")
+    {
+        update_bit_range(words.data(), BITS_PER_WORD + 3, 1, true);
+
+        CHECK(words[0] == 0);
+        CHECK(words[1] == 1UL << 3);
+    }
+
+    SECTION("The last bit of a word")
+    {
+        update_bit_range(words.data(), BITS_PER_WORD - 1, 1, true);
+
+        CHECK(words[0] == 1UL << (BITS_PER_WORD - 1));
+        CHECK(words[1] == 0);
+    }
+
+    SECTION("Exactly one word")
+    {
+        update_bit_range(words.data(), 2 * BITS_PER_WORD, BITS_PER_WORD, true);
+
+        CHECK(words[1] == 0);
+        CHECK(words[2] == ~0UL);
+        CHECK(words[3] == 0);
+    }
+
+    SECTION("Partial words on both ends")
+    {
+        update_bit_range(words.data(), BITS_PER_WORD - 4, 2 * BITS_PER_WORD + 8, true);
+
+        CHECK(words[0] == 0xfUL << (BITS_PER_WORD - 4));
+        CHECK(words[1] == ~0UL);
+        CHECK(words[2] == ~0UL);
+        CHECK(words[3] == 0xfUL);
+        CHECK(words[4] == 0);
+    }
+
+    SECTION("The whole array")
+    {
+        update_bit_range(words.data(), 0, NUM_BITS, true);
+        CHECK(words == std::vector<mword>(NUM_WORDS, ~0UL));
+
+        update_bit_range(words.data(), 0, NUM_BITS, false);
+        CHECK(words == std::vector<mword>(NUM_WORDS, 0));
+    }
+}
+
+TEST_CASE("Bit range updates match a bit-by-bit model", "[bit_range]")
+{
+    std::vector<mword> words(NUM_WORDS, 0);
+    std::vector<mword> model(NUM_WORDS, 0);
+
+    std::mt19937 rng{1234};
+    std::uniform_int_distribution<size_t> pos_dist{0, NUM_BITS};
+
+    for (size_t round{0}; round < 10000; round++) {
+        size_t a{pos_dist(rng)};
+        size_t b{pos_dist(rng)};
+
+        if (a > b) {
+            std::swap(a, b);
+        }
+
+        bool const value{rng() % 2 == 0};
+
+        update_bit_range(words.data(), a, b - a, value);
+        update_bit_by_bit(model, a, b - a, value);
+
+        REQUIRE(words == model);
+    }
+}
@@ -16,6 +16,7 @@
  */
 
 #define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
 #include <catch2/catch.hpp>
 
 // Do not write tests into this file. It is just meant to compile the
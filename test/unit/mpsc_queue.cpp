@@ -0,0 +1,137 @@
+/*
+ * Multi-Producer Single-Consumer Queue Tests
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#include <mpsc_queue.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+namespace
+{
+
+struct Element {
+    Element* next{nullptr};
+    size_t producer{0};
+    size_t seq{0};
+};
+
+} // anonymous namespace
+
+TEST_CASE("Empty MPSC queue dequeues nothing", "[mpsc_queue]")
+{
+    Mpsc_queue<Element> q;
+
+    CHECK(q.dequeue_all() == nullptr);
+}
+
+TEST_CASE("MPSC queue preserves order", "[mpsc_queue]")
+{
+    Mpsc_queue<Element> q;
+    Element a, b, c;
+
+    CHECK(q.enqueue(&a));
+    CHECK_FALSE(q.enqueue(&b));
+    CHECK_FALSE(q.enqueue(&c));
+
+    Element* list{q.dequeue_all()};
+
+    CHECK(list == &a);
+    CHECK(a.next == &b);
+    CHECK(b.next == &c);
+    CHECK(c.next == nullptr);
+
+    // The queue is empty again, so the next producer has to notify the
+    // consumer.
+    CHECK(q.dequeue_all() == nullptr);
+    CHECK(q.enqueue(&a));
+}
+
+TEST_CASE("MPSC queue stress test", "[mpsc_queue]")
+{
+    size_t const producers{4};
+    size_t const per_producer{20000};
+
+    Mpsc_queue<Element> q;
+    std::vector<std::vector<Element>> elements(producers, std::vector<Element>(per_producer));
+
+    // Models the IPI: producers count notifications, the consumer counts the
+    // ones it handled.
+    std::atomic<size_t> notifications{0};
+    std::atomic<bool> producers_done{false};
+
+    // The results are only checked after the threads are done, because Catch
+    // assertions are not thread-safe.
+    std::vector<size_t> next_seq(producers, 0);
+    size_t received{0};
+    bool in_order{true};
+
+    std::thread consumer{[&] {
+        size_t handled{0};
+
+        for (;;) {
+            bool const done{producers_done.load()};
+            size_t const pending{notifications.load()};
+
+            if (pending == handled) {
+                if (done) {
+                    break;
+                }
+
+                std::this_thread::yield();
+                continue;
+            }
+
+            handled = pending;
+
+            for (Element* e{q.dequeue_all()}; e; e = e->next) {
+                in_order = in_order and e->seq == next_seq[e->producer];
+                next_seq[e->producer] = e->seq + 1;
+                received++;
+            }
+        }
+    }};
+
+    std::vector<std::thread> workers;
+
+    for (size_t p{0}; p < producers; p++) {
+        workers.emplace_back([&, p] {
+            for (size_t i{0}; i < per_producer; i++) {
+                Element& e{elements[p][i]};
+
+                e.producer = p;
+                e.seq = i;
+
+                if (q.enqueue(&e)) {
+                    notifications++;
+                }
+            }
+        });
+    }
+
+    for (auto& w : workers) {
+        w.join();
+    }
+
+    producers_done = true;
+    consumer.join();
+
+    // If a notification was lost, elements are stranded in the queue.
+    CHECK(received == producers * per_producer);
+    CHECK(in_order);
+    CHECK(q.dequeue_all() == nullptr);
+}
@@ -24,7 +24,10 @@
 #include <cstdio>
 #include <forward_list>
 #include <initializer_list>
+#include <random>
+#include <unordered_map>
 
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
 #include <catch2/catch.hpp>
 
 namespace
@@ -158,6 +161,47 @@ public:
     }
 };
 
+// A memory backend without history for benchmarks. Fake_memory's reads get
+// slower with every write, which would dominate any measurement.
+class Flat_memory
+{
+public:
+    using entry = ::entry;
+    using pointer = ::pointer;
+
+private:
+    std::unordered_map<uint64_t, entry> memory_;
+
+public:
+
+    entry read(pointer ptr) const
+    {
+        auto it{memory_.find(ptr.addr)};
+        return it == memory_.end() ? 0 : it->second;
+    }
+
+    void write(pointer ptr, entry e) { memory_[ptr.addr] = e; }
+
+    bool cmp_swap(pointer ptr, entry old, entry desired)
+    {
+        if (read(ptr) != old) {
+            return false;
+        }
+
+        write(ptr, desired);
+        return true;
+    }
+
+    entry exchange(pointer ptr, entry desired)
+    {
+        entry const old{read(ptr)};
+
+        write(ptr, desired);
+
+        return old;
+    }
+};
+
 class Fake_page_alloc
 {
     uint64_t cur_alloc_{0x10000000};
@@ -210,6 +254,9 @@ class Fake_deferred_cleanup
     using pointer_vector = std::vector<pointer>;
     pointer_vector lazy_free_pages_;
 
+    // All pages that were released after the TLB flush.
+    pointer_vector reclaimed_pages_;
+
     Fake_deferred_cleanup(bool tlb_flush, pointer_vector const& lazy_free)
         : tlb_flush_{tlb_flush}, lazy_free_pages_{lazy_free}
     {
@@ -220,6 +267,8 @@ public:
 
     pointer_vector get_freed_pages() const { return lazy_free_pages_; }
 
+    pointer_vector get_reclaimed_pages() const { return reclaimed_pages_; }
+
     // The interface expected by Generic_page_table
 
     Fake_deferred_cleanup() = default;
@@ -234,9 +283,19 @@ public:
         tlb_flush_ = tlb_flush_ or other.tlb_flush_;
         lazy_free_pages_.insert(lazy_free_pages_.end(), other.lazy_free_pages_.cbegin(),
                                 other.lazy_free_pages_.cend());
+
+        other.tlb_flush_ = false;
+        other.lazy_free_pages_ = {};
     }
 
-    void free_pages_now() { lazy_free_pages_ = {}; }
+    void free_pages_now()
+    {
+        // Pages must not be reused before the TLB flush.
+        REQUIRE_FALSE(tlb_flush_);
+
+        reclaimed_pages_.insert(reclaimed_pages_.end(), lazy_free_pages_.cbegin(), lazy_free_pages_.cend());
+        lazy_free_pages_ = {};
+    }
 
     static Fake_deferred_cleanup tlb_flush(bool tlb_flush) { return {tlb_flush, {}}; }
 
@@ -255,12 +314,14 @@ public:
         PTE_P = 1ULL << 0,
         PTE_W = 1ULL << 1,
         PTE_U = 1ULL << 2,
+        PTE_A = 1ULL << 5,
+        PTE_D = 1ULL << 6,
         PTE_S = 1ULL << 7,
 
         PTE_NX = 1ULL << 63,
     };
 
-    static constexpr uint64_t mask{PTE_NX | PTE_P | PTE_W | PTE_U};
+    static constexpr uint64_t mask{PTE_NX | PTE_A | PTE_D | PTE_P | PTE_W | PTE_U};
     static constexpr uint64_t all_rights{PTE_P | PTE_W | PTE_U};
 };
 
@@ -273,6 +334,9 @@ public:
 using Fake_hpt = Generic_page_table<BITS_PER_LEVEL_64BIT, uint64_t, Fake_memory, Fake_flush, Fake_page_alloc,
                                     Fake_deferred_cleanup, Fake_attr>;
 
+using Flat_hpt = Generic_page_table<BITS_PER_LEVEL_64BIT, uint64_t, Flat_memory, Fake_flush, Fake_page_alloc,
+                                    Fake_deferred_cleanup, Fake_attr>;
+
 Fake_hpt::ord_t const twomb_order{PAGE_BITS + BITS_PER_LEVEL_64BIT};
 Fake_hpt::ord_t const onegb_order{PAGE_BITS + 2 * BITS_PER_LEVEL_64BIT};
 
@@ -669,6 +733,60 @@ TEST_CASE("Update that creates superpages reclaims page table structures")
     }
 }
 
+TEST_CASE("Page table structures are not reused before the TLB flush", "[page_table]")
+{
+    Fake_memory const mem{{{0x1000, 0x00002000 | Fake_attr::all_rights},
+                           {0x2000, 0x00003000 | Fake_attr::all_rights},
+                           {0x3000, 0x00004000 | Fake_attr::all_rights},
+                           {0x3008, 0x00005000 | Fake_attr::all_rights}}};
+
+    Fake_hpt hpt{4, 3, 0x1000, mem};
+    Fake_deferred_cleanup cleanup;
+
+    // Replace both 4K page tables with a 1GB superpage and then populate the
+    // region again with 4K pages. The old page tables must not be used for
+    // the new mappings.
+    hpt.update(cleanup, {0, 0, Fake_attr::PTE_P | Fake_attr::PTE_W, onegb_order});
+    hpt.update(cleanup, {0, 0, Fake_attr::PTE_P, PAGE_BITS});
+    hpt.update(cleanup, {1UL << twomb_order, 0, Fake_attr::PTE_P, PAGE_BITS});
+
+    auto const lazily_freed{cleanup.get_freed_pages()};
+
+    REQUIRE(cleanup.need_tlb_flush());
+    REQUIRE(lazily_freed.size() == 3);
+    CHECK(hpt.page_alloc().get_freed_pages().empty());
+    CHECK(cleanup.get_reclaimed_pages().empty());
+
+    for (uint64_t vaddr : {0UL, 1UL << twomb_order}) {
+        for (uint64_t level{0}; level < 2; level++) {
+            auto const table{hpt.walk_down_and_split(cleanup, vaddr, static_cast<Fake_hpt::level_t>(level))};
+
+            CHECK(std::find(lazily_freed.cbegin(), lazily_freed.cend(), table) == lazily_freed.cend());
+        }
+    }
+
+    SECTION("Pages are reclaimed once the flush has happened")
+    {
+        cleanup.ignore_tlb_flush();
+        cleanup.free_pages_now();
+
+        CHECK(cleanup.get_freed_pages().empty());
+        CHECK(cleanup.get_reclaimed_pages() == lazily_freed);
+    }
+
+    SECTION("Merging keeps pages until the flush has happened")
+    {
+        Fake_deferred_cleanup combined;
+
+        combined.merge(cleanup);
+
+        CHECK(combined.need_tlb_flush());
+        CHECK(combined.get_freed_pages() == lazily_freed);
+        CHECK_FALSE(cleanup.need_tlb_flush());
+        CHECK(cleanup.get_freed_pages().empty());
+    }
+}
+
 TEST_CASE("Mapping memory works if it has to create multiple new page tables")
 {
     Fake_memory const mem{{{0x1000, 0x00002000 | Fake_attr::all_rights},
@@ -813,3 +931,495 @@ TEST_CASE("Moving mappings works", "[page_table]")
         CHECK(moved.order == source.order);
     }
 }
+
+TEST_CASE("Page tables can be shared between hierarchies", "[page_table]")
+{
+    Fake_memory const mem{{{0x1000, 0x00002000 | Fake_attr::all_rights},
+                           {0x2000, 0x00003000 | Fake_attr::all_rights},
+                           {0x3000, 0x00004000 | Fake_attr::all_rights},
+                           {0x4000, 0xCAFE0000 | Fake_attr::PTE_P}}};
+
+    Fake_hpt source{4, 2, 0x1000, mem};
+    Fake_hpt::level_t const level{2};
+
+    // The entry that points to the page table with the 2MB entries around
+    // virtual address zero.
+    Fake_hpt::pte_t const shared_entry{source.entry_at(0, level)};
+
+    REQUIRE(shared_entry == (0x00003000 | Fake_attr::all_rights));
+
+    Fake_hpt hpt{4, 2};
+    Fake_deferred_cleanup cleanup;
+
+    REQUIRE(hpt.entry_at(0, level) == 0);
+
+    hpt.link_table(cleanup, 0, level, shared_entry);
+
+    // Populating an empty page table needs no TLB flush.
+    CHECK_FALSE(cleanup.need_tlb_flush());
+    CHECK(hpt.entry_at(0, level) == shared_entry);
+
+    SECTION("Entries can be looked up at each level")
+    {
+        CHECK(source.entry_at(0, 0) == (0xCAFE0000 | Fake_attr::PTE_P));
+        CHECK(hpt.entry_at(0, 3) != 0);
+
+        // The shared page table is not part of our memory.
+        CHECK(hpt.entry_at(0, 1) == 0);
+
+        // Nothing is mapped in the upper half.
+        CHECK(hpt.entry_at(1UL << 47, level) == 0);
+    }
+
+    SECTION("Updates below the shared entry go to the shared page table")
+    {
+        hpt.update(cleanup, {0, 0xBEEF0000, Fake_attr::PTE_P, PAGE_BITS});
+
+        CHECK(hpt.walk_down_and_split(cleanup, 0, 1) == pointer{0x3000});
+        CHECK(hpt.entry_at(0, level) == shared_entry);
+    }
+
+    SECTION("Unlinking removes the entry without freeing the page table")
+    {
+        Fake_deferred_cleanup unlink_cleanup;
+
+        CHECK(hpt.unlink_table(unlink_cleanup, 0, level) == shared_entry);
+        CHECK(unlink_cleanup.need_tlb_flush());
+        CHECK(unlink_cleanup.get_freed_pages().empty());
+        CHECK(hpt.entry_at(0, level) == 0);
+
+        // There is nothing left to unlink.
+        CHECK(hpt.unlink_table(unlink_cleanup, 0, level) == 0);
+    }
+
+    SECTION("Linking over an existing page table frees the old one")
+    {
+        Fake_deferred_cleanup link_cleanup;
+        Fake_hpt other{4, 2};
+
+        other.update(link_cleanup, {0, 0xBEEF0000, Fake_attr::PTE_P, PAGE_BITS});
+
+        auto const old_table{other.walk_down_and_split(link_cleanup, 0, 1)};
+
+        other.link_table(link_cleanup, 0, level, shared_entry);
+
+        auto const freed{link_cleanup.get_freed_pages()};
+
+        CHECK(link_cleanup.need_tlb_flush());
+        CHECK(std::find(freed.cbegin(), freed.cend(), old_table) != freed.cend());
+        CHECK(other.entry_at(0, level) == shared_entry);
+    }
+}
+
+TEST_CASE("Unlinking leaves superpages alone", "[page_table]")
+{
+    Fake_hpt hpt{4, 3};
+    Fake_deferred_cleanup cleanup;
+
+    hpt.update(cleanup, {0, 0, Fake_attr::PTE_P, onegb_order});
+
+    auto const before{hpt.lookup(0)};
+
+    CHECK(hpt.unlink_table(cleanup, 0, 2) == 0);
+    CHECK(hpt.lookup(0) == before);
+    CHECK_FALSE(cleanup.need_tlb_flush());
+}
+
+TEST_CASE("Page tables with contiguous mappings are promoted to superpages", "[page_table]")
+{
+    Fake_hpt hpt{4, 3};
+    Fake_deferred_cleanup cleanup;
+
+    uint64_t const vaddr{1UL << onegb_order};
+    uint64_t const paddr{0x40000000};
+    uint64_t const attr{Fake_attr::PTE_P | Fake_attr::PTE_W};
+    size_t const entries{1U << BITS_PER_LEVEL_64BIT};
+
+    // Populate 2MB in 4K pieces.
+    for (size_t i{0}; i < entries; i++) {
+        hpt.update(cleanup, {vaddr + i * PAGE_SIZE, paddr + i * PAGE_SIZE, attr, PAGE_BITS});
+    }
+
+    REQUIRE_FALSE(cleanup.need_tlb_flush());
+    REQUIRE(hpt.lookup(vaddr).order == PAGE_BITS);
+
+    auto const table{hpt.walk_down_and_split(cleanup, vaddr, 0, false)};
+
+    SECTION("A full page table becomes a superpage")
+    {
+        hpt.promote(cleanup, vaddr);
+
+        auto const mapping{hpt.lookup(vaddr + PAGE_SIZE)};
+
+        CHECK(mapping.vaddr == vaddr);
+        CHECK(mapping.paddr == paddr);
+        CHECK(mapping.order == twomb_order);
+
+        // Writable superpages are considered dirty, because the CPU may
+        // still set dirty bits in the old page table.
+        CHECK(mapping.attr == (attr | Fake_attr::PTE_D));
+
+        // The page table is only reclaimed after the TLB flush.
+        CHECK(cleanup.need_tlb_flush());
+        CHECK(cleanup.get_freed_pages() == std::vector<pointer>{table});
+        CHECK(hpt.page_alloc().get_freed_pages().empty());
+    }
+
+    SECTION("Accessed and dirty bits do not prevent promotion")
+    {
+        for (size_t i{0}; i < entries; i++) {
+            uint64_t const ad{i % 3 == 0 ? 0 : (i % 3 == 1 ? Fake_attr::PTE_A : Fake_attr::PTE_A | Fake_attr::PTE_D)};
+
+            hpt.update(cleanup, {vaddr + i * PAGE_SIZE, paddr + i * PAGE_SIZE, attr | ad, PAGE_BITS});
+        }
+
+        cleanup.ignore_tlb_flush();
+        hpt.promote(cleanup, vaddr);
+
+        auto const mapping{hpt.lookup(vaddr)};
+
+        CHECK(mapping.paddr == paddr);
+        CHECK(mapping.order == twomb_order);
+        CHECK(mapping.attr == (attr | Fake_attr::PTE_A | Fake_attr::PTE_D));
+        CHECK(cleanup.get_freed_pages() == std::vector<pointer>{table});
+    }
+
+    SECTION("Dirty bits of read-only entries are kept")
+    {
+        uint64_t const ro_attr{Fake_attr::PTE_P};
+
+        for (size_t i{0}; i < entries; i++) {
+            uint64_t const dirty{i == 17 ? Fake_attr::PTE_D : 0};
+
+            hpt.update(cleanup, {vaddr + i * PAGE_SIZE, paddr + i * PAGE_SIZE, ro_attr | dirty, PAGE_BITS});
+        }
+
+        cleanup.ignore_tlb_flush();
+        hpt.promote(cleanup, vaddr);
+
+        auto const mapping{hpt.lookup(vaddr)};
+
+        CHECK(mapping.order == twomb_order);
+        CHECK(mapping.attr == (ro_attr | Fake_attr::PTE_D));
+    }
+
+    SECTION("Page tables are not promoted without a request")
+    {
+        hpt.update(cleanup, {vaddr, paddr, attr, PAGE_BITS});
+
+        CHECK(hpt.lookup(vaddr).order == PAGE_BITS);
+        CHECK(cleanup.get_freed_pages().empty());
+    }
+
+    SECTION("Promotion continues at higher levels")
+    {
+        // Fill the rest of the 1GB region with 2MB pages.
+        for (size_t i{1}; i < entries; i++) {
+            uint64_t const offset{static_cast<uint64_t>(i) << twomb_order};
+
+            hpt.update(cleanup, {vaddr + offset, paddr + offset, attr, twomb_order});
+        }
+
+        hpt.promote(cleanup, vaddr);
+
+        auto const mapping{hpt.lookup(vaddr)};
+
+        CHECK(mapping.paddr == paddr);
+        CHECK(mapping.order == onegb_order);
+        CHECK(cleanup.get_freed_pages().size() == 2);
+    }
+
+    SECTION("Holes prevent promotion")
+    {
+        hpt.update(cleanup, {vaddr + 5 * PAGE_SIZE, 0, 0, PAGE_BITS});
+        cleanup.ignore_tlb_flush();
+
+        hpt.promote(cleanup, vaddr);
+
+        CHECK(hpt.lookup(vaddr).order == PAGE_BITS);
+        CHECK_FALSE(cleanup.need_tlb_flush());
+        CHECK(cleanup.get_freed_pages().empty());
+    }
+
+    SECTION("Different attributes prevent promotion")
+    {
+        hpt.update(cleanup, {vaddr + 7 * PAGE_SIZE, paddr + 7 * PAGE_SIZE, Fake_attr::PTE_P, PAGE_BITS});
+        cleanup.ignore_tlb_flush();
+
+        hpt.promote(cleanup, vaddr);
+
+        CHECK(hpt.lookup(vaddr).order == PAGE_BITS);
+        CHECK(cleanup.get_freed_pages().empty());
+    }
+
+    SECTION("Non-contiguous mappings prevent promotion")
+    {
+        hpt.update(cleanup, {vaddr + 7 * PAGE_SIZE, paddr, attr, PAGE_BITS});
+        cleanup.ignore_tlb_flush();
+
+        hpt.promote(cleanup, vaddr);
+
+        CHECK(hpt.lookup(vaddr).order == PAGE_BITS);
+        CHECK(cleanup.get_freed_pages().empty());
+    }
+}
+
+TEST_CASE("Misaligned physical memory is not promoted", "[page_table]")
+{
+    Fake_hpt hpt{4, 2};
+    Fake_deferred_cleanup cleanup;
+
+    uint64_t const paddr{0x40000000 + PAGE_SIZE};
+
+    for (size_t i{0}; i < 1U << BITS_PER_LEVEL_64BIT; i++) {
+        hpt.update(cleanup, {i * PAGE_SIZE, paddr + i * PAGE_SIZE, Fake_attr::PTE_P, PAGE_BITS});
+    }
+
+    hpt.promote(cleanup, 0);
+
+    CHECK(hpt.lookup(0).order == PAGE_BITS);
+    CHECK(cleanup.get_freed_pages().empty());
+}
+
+TEST_CASE("Page tables are not promoted beyond the supported leaf levels", "[page_table]")
+{
+    Fake_hpt hpt{4, 1};
+    Fake_deferred_cleanup cleanup;
+
+    for (size_t i{0}; i < 1U << BITS_PER_LEVEL_64BIT; i++) {
+        hpt.update(cleanup, {i * PAGE_SIZE, i * PAGE_SIZE, Fake_attr::PTE_P, PAGE_BITS});
+    }
+
+    hpt.promote(cleanup, 0);
+
+    CHECK(hpt.lookup(0).order == PAGE_BITS);
+    CHECK(cleanup.get_freed_pages().empty());
+}
+
+TEST_CASE("Cursor lookups match page table lookups", "[page_table]")
+{
+    Fake_hpt hpt{4, 3};
+    Fake_deferred_cleanup cleanup;
+
+    hpt.update(cleanup, {0, 0x10000000, Fake_attr::PTE_P, PAGE_BITS});
+    hpt.update(cleanup, {1UL << twomb_order, 0x40000000, Fake_attr::PTE_P | Fake_attr::PTE_W, twomb_order});
+    hpt.update(cleanup, {1UL << onegb_order, 0x80000000, Fake_attr::PTE_P, onegb_order});
+
+    Fake_hpt::Cursor cursor{hpt};
+
+    for (uint64_t vaddr : {0UL, 0x1000UL, 0x1ff000UL, 0x200000UL, 0x3ff000UL, 0x400000UL, 0x40000000UL,
+                           0x7ffff000UL, 0x80000000UL, 0x1000UL, 0UL, 1UL << 39}) {
+        CHECK(cursor.lookup(vaddr) == hpt.lookup(vaddr));
+    }
+}
+
+TEST_CASE("Cursor updates match page table updates", "[page_table]")
+{
+    std::mt19937 rng{1234};
+
+    for (size_t round{0}; round < 20; round++) {
+        Fake_hpt expected{4, 3};
+        Fake_hpt actual{4, 3};
+        Fake_deferred_cleanup expected_cleanup;
+        Fake_deferred_cleanup actual_cleanup;
+
+        Fake_hpt::Cursor cursor{actual};
+
+        // A sorted sequence of mappings and unmappings of different sizes
+        // within 4GB.
+        std::vector<Fake_hpt::Mapping> maps;
+        uint64_t vaddr{0};
+
+        for (size_t i{0}; i < 64; i++) {
+            Fake_hpt::ord_t const order{rng() % 2 == 0 ? PAGE_BITS : twomb_order};
+            uint64_t const size{1UL << order};
+
+            vaddr = (vaddr + (rng() % 4) * size + size - 1) & ~(size - 1);
+
+            if (vaddr >= 1UL << 32) {
+                break;
+            }
+
+            uint64_t const attr{rng() % 4 == 0 ? 0 : Fake_attr::PTE_P};
+            Fake_hpt::Mapping const map{vaddr, vaddr + 0x100000000, attr, order};
+
+            expected.update(expected_cleanup, map);
+            cursor.update(actual_cleanup, map);
+            maps.push_back(map);
+
+            vaddr += size;
+        }
+
+        CHECK(actual_cleanup.need_tlb_flush() == expected_cleanup.need_tlb_flush());
+
+        for (auto const& map : maps) {
+            for (uint64_t addr : {map.vaddr - PAGE_SIZE, map.vaddr, map.vaddr + map.size() - PAGE_SIZE}) {
+                REQUIRE(actual.lookup(addr) == expected.lookup(addr));
+            }
+        }
+    }
+}
+
+TEST_CASE("Cursors notice page tables that updates removed", "[page_table]")
+{
+    Fake_hpt hpt{4, 3};
+    Fake_deferred_cleanup cleanup;
+    Fake_hpt::Cursor cursor{hpt};
+
+    cursor.update(cleanup, {0, 0, Fake_attr::PTE_P, PAGE_BITS});
+
+    // Replace the page tables the cursor just walked with a 1GB page and
+    // populate the region again.
+    cursor.update(cleanup, {0, 0x40000000, Fake_attr::PTE_P, onegb_order});
+    cursor.update(cleanup, {PAGE_SIZE, 0x1000, Fake_attr::PTE_P, PAGE_BITS});
+
+    auto const freed{cleanup.get_freed_pages()};
+    auto const table{hpt.walk_down_and_split(cleanup, PAGE_SIZE, 0)};
+
+    CHECK(std::find(freed.cbegin(), freed.cend(), table) == freed.cend());
+    CHECK(hpt.lookup(PAGE_SIZE).paddr == 0x1000);
+    CHECK(hpt.lookup(0).paddr == 0x40000000);
+}
+
+TEST_CASE("Reset cursors notice page tables that were replaced elsewhere", "[page_table]")
+{
+    Fake_hpt hpt{4, 3};
+    Fake_deferred_cleanup cleanup;
+    Fake_hpt::Cursor cursor{hpt};
+
+    cursor.update(cleanup, {0, 0, Fake_attr::PTE_P, PAGE_BITS});
+
+    // Replace the page tables the cursor just walked behind its back.
+    hpt.update(cleanup, {0, 0x40000000, Fake_attr::PTE_P, onegb_order});
+
+    cursor.reset();
+    cursor.update(cleanup, {PAGE_SIZE, 0x1000, Fake_attr::PTE_P, PAGE_BITS});
+
+    CHECK(hpt.lookup(PAGE_SIZE).paddr == 0x1000);
+    CHECK(hpt.lookup(0).paddr == 0x40000000);
+}
+
+TEST_CASE("All mappings in a range are visited", "[page_table]")
+{
+    Fake_hpt hpt{4, 3};
+    Fake_deferred_cleanup cleanup;
+
+    hpt.update(cleanup, {0, 0x10000000, Fake_attr::PTE_P, PAGE_BITS});
+    hpt.update(cleanup, {2 * PAGE_SIZE, 0x10002000, Fake_attr::PTE_P, PAGE_BITS});
+    hpt.update(cleanup, {1UL << twomb_order, 0x40000000, Fake_attr::PTE_P, twomb_order});
+    hpt.update(cleanup, {1UL << onegb_order, 0x80000000, Fake_attr::PTE_P, onegb_order});
+
+    std::vector<Fake_hpt::Mapping> visited;
+    auto const collect{[&visited](pointer, Fake_hpt::Mapping const& m) { visited.push_back(m); }};
+
+    SECTION("Holes are skipped")
+    {
+        hpt.for_each_mapping(0, 1UL << twomb_order, collect);
+
+        REQUIRE(visited.size() == 2);
+        CHECK(visited[0] == hpt.lookup(0));
+        CHECK(visited[1] == hpt.lookup(2 * PAGE_SIZE));
+    }
+
+    SECTION("Superpages that overlap the range are visited")
+    {
+        hpt.for_each_mapping((1UL << twomb_order) + PAGE_SIZE, (1UL << onegb_order) + PAGE_SIZE, collect);
+
+        REQUIRE(visited.size() == 2);
+        CHECK(visited[0] == hpt.lookup(1UL << twomb_order));
+        CHECK(visited[1] == hpt.lookup(1UL << onegb_order));
+    }
+
+    SECTION("Empty ranges visit nothing")
+    {
+        hpt.for_each_mapping(PAGE_SIZE, PAGE_SIZE, collect);
+
+        CHECK(visited.empty());
+    }
+}
+
+TEST_CASE("Clearing dirty bits reports dirty mappings", "[page_table]")
+{
+    Fake_hpt hpt{4, 3};
+    Fake_deferred_cleanup cleanup;
+
+    uint64_t const clean{Fake_attr::PTE_P | Fake_attr::PTE_W};
+    uint64_t const dirty{clean | Fake_attr::PTE_D};
+
+    for (size_t i{0}; i < 8; i++) {
+        hpt.update(cleanup, {i * PAGE_SIZE, 0x10000000 + i * PAGE_SIZE, i % 3 == 0 ? dirty : clean, PAGE_BITS});
+    }
+
+    REQUIRE_FALSE(cleanup.need_tlb_flush());
+
+    std::vector<uint64_t> marked;
+    auto const mark{[&marked](Fake_hpt::Mapping const& m) { marked.push_back(m.vaddr); }};
+
+    SECTION("Dirty bits in the range are cleared and reported")
+    {
+        hpt.clear_dirty(cleanup, PAGE_SIZE, 7 * PAGE_SIZE, mark);
+
+        CHECK(marked == std::vector<uint64_t>{3 * PAGE_SIZE, 6 * PAGE_SIZE});
+        CHECK(cleanup.need_tlb_flush());
+
+        CHECK(hpt.lookup(3 * PAGE_SIZE).attr == clean);
+        CHECK(hpt.lookup(6 * PAGE_SIZE).attr == clean);
+
+        // Mappings outside of the range are left alone.
+        CHECK(hpt.lookup(0).attr == dirty);
+    }
+
+    SECTION("Clean mappings need no TLB flush")
+    {
+        hpt.clear_dirty(cleanup, PAGE_SIZE, 3 * PAGE_SIZE, mark);
+
+        CHECK(marked.empty());
+        CHECK_FALSE(cleanup.need_tlb_flush());
+    }
+
+    SECTION("Dirty bits are only reported once")
+    {
+        hpt.clear_dirty(cleanup, 0, 8 * PAGE_SIZE, mark);
+        CHECK(marked.size() == 3);
+
+        Fake_deferred_cleanup second_cleanup;
+
+        marked.clear();
+        hpt.clear_dirty(second_cleanup, 0, 8 * PAGE_SIZE, mark);
+
+        CHECK(marked.empty());
+        CHECK_FALSE(second_cleanup.need_tlb_flush());
+    }
+}
+
+TEST_CASE("Range update", "[.][benchmark][page_table]")
+{
+    // Map 2MB in 4K pieces, as a fragmented delegation would.
+    size_t const entries{1U << BITS_PER_LEVEL_64BIT};
+    uint64_t const vaddr{1UL << onegb_order};
+
+    BENCHMARK("Walk from the root")
+    {
+        Flat_hpt hpt{4, 2};
+        Fake_deferred_cleanup cleanup;
+
+        for (size_t i{0}; i < entries; i++) {
+            hpt.update(cleanup, {vaddr + i * PAGE_SIZE, i * PAGE_SIZE, Fake_attr::PTE_P, PAGE_BITS});
+        }
+
+        return cleanup.need_tlb_flush();
+    };
+
+    BENCHMARK("Cursor")
+    {
+        Flat_hpt hpt{4, 2};
+        Fake_deferred_cleanup cleanup;
+        Flat_hpt::Cursor cursor{hpt};
+
+        for (size_t i{0}; i < entries; i++) {
+            cursor.update(cleanup, {vaddr + i * PAGE_SIZE, i * PAGE_SIZE, Fake_attr::PTE_P, PAGE_BITS});
+        }
+
+        return cleanup.need_tlb_flush();
+    };
+}
@@ -0,0 +1,230 @@
+/*
+ * Pairing Heap Tests
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#include <pairing_heap.hpp>
+
+#include <cstdint>
+#include <random>
+#include <set>
+#include <vector>
+
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+
+namespace
+{
+
+struct Fake_timeout {
+    Fake_timeout* prev{nullptr};
+    Fake_timeout* next{nullptr};
+    Fake_timeout* child{nullptr};
+    uint64_t time{0};
+};
+
+using Heap = Pairing_heap<Fake_timeout>;
+
+// The sorted list that Timeout used before. Insertion walks the list to find
+// the right spot.
+class Sorted_list
+{
+    Fake_timeout* head_{nullptr};
+
+public:
+    Fake_timeout* min() const { return head_; }
+
+    void insert(Fake_timeout* t)
+    {
+        Fake_timeout* p{nullptr};
+
+        for (Fake_timeout* n{head_}; n; p = n, n = n->next) {
+            if (n->time >= t->time) {
+                break;
+            }
+        }
+
+        t->prev = p;
+
+        if (!p) {
+            t->next = head_;
+            head_ = t;
+        } else {
+            t->next = p->next;
+            p->next = t;
+        }
+
+        if (t->next) {
+            t->next->prev = t;
+        }
+    }
+
+    void remove(Fake_timeout* t)
+    {
+        if (t->next) {
+            t->next->prev = t->prev;
+        }
+
+        if (t->prev) {
+            t->prev->next = t->next;
+        } else {
+            head_ = t->next;
+        }
+
+        t->prev = t->next = nullptr;
+    }
+};
+
+} // anonymous namespace
+
+TEST_CASE("Empty pairing heap", "[pairing_heap]")
+{
+    Heap heap;
+    Fake_timeout t;
+
+    CHECK(heap.empty());
+    CHECK(heap.min() == nullptr);
+    CHECK_FALSE(heap.contains(&t));
+}
+
+TEST_CASE("Pairing heap returns elements in order", "[pairing_heap]")
+{
+    Heap heap;
+    std::vector<Fake_timeout> timeouts(100);
+
+    for (size_t i{0}; i < timeouts.size(); i++) {
+        // Insert in a scrambled order.
+        timeouts[i].time = (i * 37) % timeouts.size();
+        heap.insert(&timeouts[i]);
+    }
+
+    for (uint64_t expected{0}; expected < timeouts.size(); expected++) {
+        Fake_timeout* t{heap.min()};
+
+        REQUIRE(t != nullptr);
+        CHECK(t->time == expected);
+
+        heap.remove(t);
+        CHECK_FALSE(heap.contains(t));
+    }
+
+    CHECK(heap.empty());
+}
+
+TEST_CASE("Pairing heap removes arbitrary elements", "[pairing_heap]")
+{
+    Heap heap;
+    Fake_timeout a, b, c, d;
+
+    a.time = 1;
+    b.time = 2;
+    c.time = 3;
+    d.time = 4;
+
+    for (auto* t : {&c, &a, &d, &b}) {
+        heap.insert(t);
+    }
+
+    heap.remove(&c);
+    CHECK(heap.min() == &a);
+    CHECK_FALSE(heap.contains(&c));
+
+    heap.remove(&a);
+    CHECK(heap.min() == &b);
+
+    heap.remove(&d);
+    CHECK(heap.min() == &b);
+
+    heap.remove(&b);
+    CHECK(heap.empty());
+}
+
+TEST_CASE("Pairing heap matches a reference model", "[pairing_heap]")
+{
+    Heap heap;
+    std::multiset<uint64_t> model;
+    std::vector<Fake_timeout> timeouts(256);
+
+    std::mt19937_64 rng{42};
+
+    for (size_t round{0}; round < 20000; round++) {
+        Fake_timeout& t{timeouts[rng() % timeouts.size()]};
+
+        if (heap.contains(&t)) {
+            model.erase(model.find(t.time));
+            heap.remove(&t);
+        } else if (rng() % 4 == 0 and not heap.empty()) {
+            // Expire the earliest timeout.
+            Fake_timeout* first{heap.min()};
+
+            model.erase(model.find(first->time));
+            heap.remove(first);
+        } else {
+            // Use a small range to get plenty of duplicates.
+            t.time = rng() % 1000;
+
+            model.insert(t.time);
+            heap.insert(&t);
+        }
+
+        REQUIRE(heap.empty() == model.empty());
+
+        if (not model.empty()) {
+            REQUIRE(heap.min()->time == *model.begin());
+        }
+    }
+}
+
+TEST_CASE("Timeout insert and cancel", "[.][benchmark][pairing_heap]")
+{
+    // Many ECs are blocked with a timeout, while a single one repeatedly
+    // blocks and gets woken up before its timeout expires.
+    auto block_wakeup = [](auto& queue, std::vector<Fake_timeout>& blocked, Fake_timeout& t) {
+        for (auto& b : blocked) {
+            queue.insert(&b);
+        }
+
+        for (size_t i{0}; i < 1000; i++) {
+            t.time = 500 + i % 100;
+            queue.insert(&t);
+            queue.remove(&t);
+        }
+
+        for (auto& b : blocked) {
+            queue.remove(&b);
+        }
+
+        return queue.min();
+    };
+
+    for (size_t n : {10, 100, 1000}) {
+        std::vector<Fake_timeout> blocked(n);
+        Fake_timeout t;
+
+        for (size_t i{0}; i < n; i++) {
+            blocked[i].time = i;
+        }
+
+        BENCHMARK("Sorted list, " + std::to_string(n) + " timeouts")
+        {
+            Sorted_list list;
+            return block_wakeup(list, blocked, t);
+        };
+
+        BENCHMARK("Pairing heap, " + std::to_string(n) + " timeouts")
+        {
+            Heap heap;
+            return block_wakeup(heap, blocked, t);
+        };
+    }
+}
@@ -0,0 +1,152 @@
+/*
+ * PCID Allocator Tests
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#include <pcid_allocator.hpp>
+
+#include <map>
+#include <random>
+#include <set>
+
+#include <catch2/catch.hpp>
+
+namespace
+{
+
+constexpr size_t NUM_PCIDS{4};
+
+using Allocator = Pcid_allocator<NUM_PCIDS>;
+
+} // anonymous namespace
+
+TEST_CASE("New address spaces get distinct PCIDs", "[pcid_allocator]")
+{
+    Allocator alloc;
+    std::set<uint16> pcids;
+
+    for (uint64 tag{1}; tag <= NUM_PCIDS; tag++) {
+        CHECK(alloc.lookup(tag) == 0);
+
+        auto const a{alloc.assign(tag)};
+
+        CHECK(a.needs_flush);
+        CHECK(a.pcid != 0);
+        CHECK(a.pcid <= NUM_PCIDS);
+        CHECK(pcids.insert(a.pcid).second);
+        CHECK(alloc.lookup(tag) == a.pcid);
+    }
+}
+
+TEST_CASE("Address spaces keep their PCID without a flush", "[pcid_allocator]")
+{
+    Allocator alloc;
+
+    uint16 const pcid_a{alloc.assign(1).pcid};
+    uint16 const pcid_b{alloc.assign(2).pcid};
+
+    for (size_t i{0}; i < 10; i++) {
+        auto const a{alloc.assign(1)};
+        auto const b{alloc.assign(2)};
+
+        CHECK(a.pcid == pcid_a);
+        CHECK(not a.needs_flush);
+        CHECK(b.pcid == pcid_b);
+        CHECK(not b.needs_flush);
+    }
+}
+
+TEST_CASE("The least recently used PCID is recycled", "[pcid_allocator]")
+{
+    Allocator alloc;
+
+    for (uint64 tag{1}; tag <= NUM_PCIDS; tag++) {
+        alloc.assign(tag);
+    }
+
+    // Touch all but tag 2, which makes it the least recently used one.
+    alloc.assign(1);
+    alloc.assign(3);
+    alloc.assign(4);
+
+    uint16 const old_pcid{alloc.lookup(2)};
+    auto const a{alloc.assign(5)};
+
+    CHECK(a.pcid == old_pcid);
+    CHECK(a.needs_flush);
+    CHECK(alloc.lookup(2) == 0);
+
+    // The other address spaces are not affected.
+    CHECK(not alloc.assign(1).needs_flush);
+    CHECK(not alloc.assign(3).needs_flush);
+    CHECK(not alloc.assign(4).needs_flush);
+
+    // The evicted address space comes back with a flush and displaces the
+    // next least recently used one, which is now tag 5.
+    auto const b{alloc.assign(2)};
+
+    CHECK(b.needs_flush);
+    CHECK(b.pcid == a.pcid);
+    CHECK(alloc.lookup(5) == 0);
+}
+
+TEST_CASE("PCID assignment matches an LRU model", "[pcid_allocator]")
+{
+    Allocator alloc;
+
+    // Maps tags to PCIDs and the time of their last use.
+    std::map<uint64, std::pair<uint16, uint64>> model;
+
+    std::mt19937 rng{1234};
+    std::uniform_int_distribution<uint64> tag_dist{1, 3 * NUM_PCIDS};
+
+    for (uint64 now{1}; now < 10000; now++) {
+        uint64 const tag{tag_dist(rng)};
+        auto const a{alloc.assign(tag)};
+
+        REQUIRE(a.pcid != 0);
+        REQUIRE(a.pcid <= NUM_PCIDS);
+
+        auto it{model.find(tag)};
+
+        if (it != model.end()) {
+            REQUIRE(not a.needs_flush);
+            REQUIRE(a.pcid == it->second.first);
+
+            it->second.second = now;
+            continue;
+        }
+
+        REQUIRE(a.needs_flush);
+
+        if (model.size() == NUM_PCIDS) {
+            auto lru{model.begin()};
+
+            for (auto i{model.begin()}; i != model.end(); ++i) {
+                if (i->second.second < lru->second.second) {
+                    lru = i;
+                }
+            }
+
+            REQUIRE(a.pcid == lru->second.first);
+            model.erase(lru);
+        }
+
+        // No two address spaces share a PCID.
+        for (auto const& entry : model) {
+            REQUIRE(entry.second.first != a.pcid);
+        }
+
+        model[tag] = {a.pcid, now};
+    }
+}
@@ -0,0 +1,251 @@
+/*
+ * Ready Queue Tests
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#include <ready_queue.hpp>
+
+#include <random>
+#include <vector>
+
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+
+namespace
+{
+
+constexpr size_t NUM_PRIO{128};
+
+struct Fake_sc {
+    Fake_sc* prev{nullptr};
+    Fake_sc* next{nullptr};
+    unsigned prio;
+
+    explicit Fake_sc(unsigned p) : prio(p) {}
+};
+
+using Queue = Ready_queue<Fake_sc, NUM_PRIO>;
+
+// The ready queue implementation Sc used before, which walks down the
+// priorities to find the next non-empty queue when an element is removed.
+class Linear_queue
+{
+    Fake_sc* heads_[NUM_PRIO]{};
+    unsigned top_{0};
+
+public:
+    Fake_sc* top() const { return heads_[top_]; }
+
+    void enqueue(Fake_sc* t, unsigned prio, bool front)
+    {
+        if (prio > top_) {
+            top_ = prio;
+        }
+
+        if (!heads_[prio]) {
+            heads_[prio] = t->prev = t->next = t;
+        } else {
+            t->next = heads_[prio];
+            t->prev = heads_[prio]->prev;
+            t->next->prev = t->prev->next = t;
+            if (front) {
+                heads_[prio] = t;
+            }
+        }
+    }
+
+    void dequeue(Fake_sc* t, unsigned prio)
+    {
+        if (heads_[prio] == t) {
+            heads_[prio] = t->next == t ? nullptr : t->next;
+        }
+
+        t->next->prev = t->prev;
+        t->prev->next = t->next;
+        t->prev = t->next = nullptr;
+
+        while (!heads_[top_] && top_) {
+            top_--;
+        }
+    }
+};
+
+} // anonymous namespace
+
+TEST_CASE("Empty ready queue has no top", "[ready_queue]")
+{
+    Queue q;
+
+    CHECK(q.empty());
+    CHECK(q.top() == nullptr);
+    CHECK(q.top_prio() == 0);
+}
+
+TEST_CASE("Ready queue finds the highest priority", "[ready_queue]")
+{
+    Queue q;
+    Fake_sc low{0}, mid{63}, high{64}, highest{NUM_PRIO - 1};
+
+    q.enqueue(&mid, mid.prio, false);
+    CHECK(q.top() == &mid);
+
+    q.enqueue(&low, low.prio, false);
+    q.enqueue(&highest, highest.prio, false);
+    q.enqueue(&high, high.prio, false);
+
+    CHECK(q.top() == &highest);
+    CHECK(q.top_prio() == NUM_PRIO - 1);
+
+    q.dequeue(&highest, highest.prio);
+    CHECK(q.top() == &high);
+    CHECK(q.top_prio() == 64);
+
+    // Crossing a bitmap word boundary.
+    q.dequeue(&high, high.prio);
+    CHECK(q.top() == &mid);
+
+    q.dequeue(&mid, mid.prio);
+    CHECK(q.top() == &low);
+    CHECK(not q.empty());
+
+    q.dequeue(&low, low.prio);
+    CHECK(q.empty());
+    CHECK(low.prev == nullptr);
+    CHECK(low.next == nullptr);
+}
+
+TEST_CASE("Ready queue is round-robin within a priority", "[ready_queue]")
+{
+    Queue q;
+    Fake_sc a{5}, b{5}, c{5};
+
+    q.enqueue(&a, 5, false);
+    q.enqueue(&b, 5, false);
+
+    SECTION("Elements are appended by default")
+    {
+        q.enqueue(&c, 5, false);
+
+        CHECK(q.top() == &a);
+        q.dequeue(&a, 5);
+        CHECK(q.top() == &b);
+        q.dequeue(&b, 5);
+        CHECK(q.top() == &c);
+    }
+
+    SECTION("Elements can be put in front")
+    {
+        q.enqueue(&c, 5, true);
+
+        CHECK(q.top() == &c);
+        q.dequeue(&c, 5);
+        CHECK(q.top() == &a);
+    }
+
+    SECTION("Removing an element from the middle keeps the order")
+    {
+        q.enqueue(&c, 5, false);
+        q.dequeue(&b, 5);
+
+        CHECK(q.head(5) == &a);
+        CHECK(a.next == &c);
+        CHECK(c.next == &a);
+    }
+}
+
+TEST_CASE("Ready queue matches the linear implementation", "[ready_queue]")
+{
+    Queue q;
+    Linear_queue ref;
+
+    std::mt19937 rng{1234};
+    std::uniform_int_distribution<unsigned> prio_dist{0, NUM_PRIO - 1};
+
+    std::vector<Fake_sc> q_scs, ref_scs;
+    for (size_t i{0}; i < 64; i++) {
+        unsigned const prio{prio_dist(rng)};
+
+        q_scs.emplace_back(prio);
+        ref_scs.emplace_back(prio);
+    }
+
+    for (size_t round{0}; round < 10000; round++) {
+        size_t const i{rng() % q_scs.size()};
+        bool const front{rng() % 2 == 0};
+
+        Fake_sc& q_sc{q_scs[i]};
+        Fake_sc& ref_sc{ref_scs[i]};
+
+        if (q_sc.next) {
+            q.dequeue(&q_sc, q_sc.prio);
+            ref.dequeue(&ref_sc, ref_sc.prio);
+        } else {
+            q.enqueue(&q_sc, q_sc.prio, front);
+            ref.enqueue(&ref_sc, ref_sc.prio, front);
+        }
+
+        // Compare by index, because both sides use their own elements.
+        Fake_sc* const q_top{q.top()};
+        Fake_sc* const ref_top{ref.top()};
+
+        REQUIRE((q_top == nullptr) == (ref_top == nullptr));
+
+        if (q_top) {
+            REQUIRE(q_top - q_scs.data() == ref_top - ref_scs.data());
+        }
+    }
+}
+
+TEST_CASE("Ready queue IPC ping-pong", "[.][benchmark][ready_queue]")
+{
+    // Two high-priority threads alternate blocking and waking each other up,
+    // as in a semaphore ping-pong. A low-priority thread is always ready, so
+    // every block makes the linear queue walk down to it.
+    auto ping_pong = [](auto& q, Fake_sc& idle, Fake_sc& ping, Fake_sc& pong) {
+        q.enqueue(&idle, idle.prio, false);
+        q.enqueue(&ping, ping.prio, false);
+
+        Fake_sc* sum{nullptr};
+
+        for (size_t i{0}; i < 1000; i++) {
+            q.dequeue(&ping, ping.prio);
+            sum = q.top();
+            q.enqueue(&pong, pong.prio, false);
+            sum = q.top();
+
+            q.dequeue(&pong, pong.prio);
+            sum = q.top();
+            q.enqueue(&ping, ping.prio, false);
+            sum = q.top();
+        }
+
+        q.dequeue(&ping, ping.prio);
+        q.dequeue(&idle, idle.prio);
+
+        return sum;
+    };
+
+    Fake_sc idle{0}, ping{NUM_PRIO - 1}, pong{NUM_PRIO - 1};
+
+    BENCHMARK("Linear walk")
+    {
+        Linear_queue q;
+        return ping_pong(q, idle, ping, pong);
+    };
+
+    BENCHMARK("Priority bitmap")
+    {
+        Queue q;
+        return ping_pong(q, idle, ping, pong);
+    };
+}
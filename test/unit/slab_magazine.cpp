@@ -0,0 +1,333 @@
+/*
+ * Slab Magazine Tests
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#include <slab_magazine.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+
+namespace
+{
+
+// A slab backend that hands out objects from a fixed pool and protects it
+// with a single lock, just like Slab_cache. It is used from multiple threads
+// in the benchmark, so it must not use Catch assertions.
+class Fake_slab
+{
+    std::mutex lock_;
+    std::vector<void*> free_;
+    std::vector<uint64_t> storage_;
+
+public:
+    size_t bulk_allocs{0};
+    size_t bulk_frees{0};
+
+    size_t available() const { return free_.size(); }
+
+    void* alloc()
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+
+        assert(not free_.empty());
+
+        void* obj{free_.back()};
+        free_.pop_back();
+        return obj;
+    }
+
+    void free(void* obj)
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        free_.push_back(obj);
+    }
+
+    // The interface below is expected by Slab_magazine.
+
+    size_t alloc_bulk(void** objs, size_t n)
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+
+        n = std::min(n, free_.size());
+
+        bulk_allocs++;
+        for (size_t i{0}; i < n; i++) {
+            objs[i] = free_.back();
+            free_.pop_back();
+        }
+
+        return n;
+    }
+
+    void free_bulk(void* const* objs, size_t n)
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+
+        bulk_frees++;
+        free_.insert(free_.end(), objs, objs + n);
+    }
+
+    explicit Fake_slab(size_t objects) : storage_(objects)
+    {
+        for (auto& obj : storage_) {
+            free_.push_back(&obj);
+        }
+    }
+};
+
+using Magazine = Slab_magazine<16>;
+
+// A set of threads that run the same work together each time run() is
+// called. The threads are created up front, so the benchmark only measures
+// the work itself.
+class Thread_team
+{
+    std::mutex lock_;
+    std::condition_variable cv_;
+
+    size_t round_{0};
+    size_t done_{0};
+    bool stop_{false};
+
+    std::function<void()> work_;
+    std::vector<std::thread> threads_;
+
+    void thread_loop()
+    {
+        for (size_t seen{0};;) {
+            {
+                std::unique_lock<std::mutex> guard(lock_);
+
+                cv_.wait(guard, [&] { return stop_ or round_ != seen; });
+
+                if (stop_) {
+                    return;
+                }
+
+                seen = round_;
+            }
+
+            work_();
+
+            std::lock_guard<std::mutex> guard(lock_);
+
+            done_++;
+            cv_.notify_all();
+        }
+    }
+
+public:
+    Thread_team(size_t threads, std::function<void()> work) : work_{std::move(work)}
+    {
+        for (size_t t{0}; t < threads; t++) {
+            threads_.emplace_back([this] { thread_loop(); });
+        }
+    }
+
+    // Run the work once on all threads and wait for them to finish.
+    void run()
+    {
+        std::unique_lock<std::mutex> guard(lock_);
+
+        done_ = 0;
+        round_++;
+        cv_.notify_all();
+
+        cv_.wait(guard, [&] { return done_ == threads_.size(); });
+    }
+
+    ~Thread_team()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+
+            stop_ = true;
+            cv_.notify_all();
+        }
+
+        std::for_each(threads_.begin(), threads_.end(), [](auto& t) { t.join(); });
+    }
+};
+
+} // anonymous namespace
+
+TEST_CASE("Magazine refills from the backend in batches", "[slab_magazine]")
+{
+    Fake_slab slab{64};
+    Magazine mag;
+
+    CHECK(mag.size() == 0);
+
+    void* const obj{mag.alloc(slab)};
+
+    CHECK(obj != nullptr);
+    CHECK(slab.bulk_allocs == 1);
+    CHECK(mag.size() == Magazine::max_size() / 2 - 1);
+    CHECK(slab.available() == 64 - Magazine::max_size() / 2);
+
+    // Allocating the rest of the batch does not touch the backend.
+    for (size_t i{0}; i < Magazine::max_size() / 2 - 1; i++) {
+        mag.alloc(slab);
+    }
+
+    CHECK(slab.bulk_allocs == 1);
+    CHECK(mag.size() == 0);
+}
+
+TEST_CASE("Magazine returns objects to the backend in batches", "[slab_magazine]")
+{
+    Fake_slab slab{64};
+    Magazine mag;
+    std::vector<void*> objs;
+
+    for (size_t i{0}; i < Magazine::max_size() + 1; i++) {
+        objs.push_back(slab.alloc());
+    }
+
+    for (size_t i{0}; i < Magazine::max_size(); i++) {
+        mag.free(slab, objs[i]);
+    }
+
+    CHECK(slab.bulk_frees == 0);
+    CHECK(mag.size() == Magazine::max_size());
+
+    mag.free(slab, objs.back());
+
+    CHECK(slab.bulk_frees == 1);
+    CHECK(mag.size() == Magazine::max_size() / 2 + 1);
+
+    // Alternating between allocation and free at the boundary doesn't
+    // bounce objects between magazine and backend.
+    for (size_t i{0}; i < 10; i++) {
+        mag.free(slab, mag.alloc(slab));
+    }
+
+    CHECK(slab.bulk_allocs == 0);
+    CHECK(slab.bulk_frees == 1);
+}
+
+TEST_CASE("Magazine copes with a backend running out of objects", "[slab_magazine]")
+{
+    size_t const objects{Magazine::max_size() / 2 + 3};
+    Fake_slab slab{objects};
+    Magazine mag;
+    std::set<void*> live;
+
+    for (size_t i{0}; i < objects; i++) {
+        void* obj{mag.alloc(slab)};
+
+        REQUIRE(obj != nullptr);
+        REQUIRE(live.insert(obj).second);
+    }
+
+    CHECK(mag.alloc(slab) == nullptr);
+    CHECK(mag.size() == 0);
+
+    // Objects that come back can be handed out again.
+    mag.free(slab, *live.begin());
+
+    CHECK(mag.alloc(slab) == *live.begin());
+}
+
+TEST_CASE("Magazine never hands out an object twice", "[slab_magazine]")
+{
+    Fake_slab slab{256};
+    Magazine mag;
+    std::set<void*> live;
+
+    for (size_t round{0}; round < 4; round++) {
+        for (size_t i{0}; i < 100; i++) {
+            void* obj{mag.alloc(slab)};
+
+            REQUIRE(live.insert(obj).second);
+        }
+
+        // Free every other object to mix magazine and backend objects.
+        for (auto it{live.begin()}; it != live.end();) {
+            mag.free(slab, *it);
+            it = live.erase(it);
+
+            if (it != live.end()) {
+                ++it;
+            }
+        }
+    }
+
+    for (void* obj : live) {
+        mag.free(slab, obj);
+    }
+
+    mag.drain(slab);
+
+    CHECK(mag.size() == 0);
+    CHECK(slab.available() == 256);
+}
+
+TEST_CASE("Slab alloc/free throughput", "[.][benchmark][slab_magazine]")
+{
+    size_t const ops_per_thread{10000};
+    size_t const objs_per_thread{32};
+
+    // Each thread keeps a few objects alive to simulate a realistic
+    // allocation pattern.
+    auto worker = [](auto&& alloc, auto&& free) {
+        std::vector<void*> objs;
+
+        for (size_t i{0}; i < ops_per_thread; i++) {
+            objs.push_back(alloc());
+
+            if (objs.size() == objs_per_thread) {
+                std::for_each(objs.begin(), objs.end(), free);
+                objs.clear();
+            }
+        }
+
+        std::for_each(objs.begin(), objs.end(), free);
+    };
+
+    for (size_t threads : {1, 2, 4, 8}) {
+        Fake_slab slab{threads * (objs_per_thread + Magazine::max_size())};
+
+        auto const shared_lock = [&] {
+            worker([&] { return slab.alloc(); }, [&](void* obj) { slab.free(obj); });
+        };
+
+        auto const magazines = [&] {
+            Magazine mag;
+
+            worker([&] { return mag.alloc(slab); }, [&](void* obj) { mag.free(slab, obj); });
+            mag.drain(slab);
+        };
+
+        {
+            Thread_team team{threads, shared_lock};
+            BENCHMARK("Shared lock, " + std::to_string(threads) + " threads") { team.run(); };
+        }
+
+        {
+            Thread_team team{threads, magazines};
+            BENCHMARK("Per-thread magazines, " + std::to_string(threads) + " threads") { team.run(); };
+        }
+    }
+}
@@ -18,6 +18,7 @@
 #include "string.hpp"
 #include "string_impl.hpp"
 
+#include <algorithm>
 #include <array>
 #include <catch2/catch.hpp>
 
@@ -62,6 +63,30 @@ TEST_CASE("memset works", "[string]")
     CHECK(array == expected);
 }
 
+TEST_CASE("memzero_stosq works", "[string]")
+{
+    std::array<uint64_t, 4> array = {1, 2, 3, 4};
+
+    impl_memzero_stosq(array.data() + 1, 2 * sizeof(uint64_t));
+
+    std::array<uint64_t, 4> const expected = {1, 0, 0, 4};
+    CHECK(array == expected);
+}
+
+TEST_CASE("memzero_nt works", "[string]")
+{
+    alignas(32) std::array<uint64_t, 12> array;
+    array.fill(~0ULL);
+
+    impl_memzero_nt(array.data() + 4, 4 * sizeof(uint64_t));
+
+    std::array<uint64_t, 12> expected;
+    expected.fill(~0ULL);
+    std::fill(expected.begin() + 4, expected.begin() + 8, 0);
+
+    CHECK(array == expected);
+}
+
 TEST_CASE("String prefix match", "[string]")
 {
     char const* string{"foo bar"};
@@ -0,0 +1,223 @@
+/*
+ * TLB Cleanup Tests
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#include <tlb_cleanup.hpp>
+
+#include <unordered_map>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+namespace
+{
+
+using page_vector = std::vector<mword>;
+
+// Stands in for the buddy allocator metadata. Links are kept outside of the
+// pages, just like in the allocator.
+class Fake_page_link
+{
+public:
+    static inline std::unordered_map<mword, mword> links;
+    static inline page_vector freed;
+
+    static void reset()
+    {
+        links.clear();
+        freed.clear();
+    }
+
+    static void set_link(mword page, mword next) { links[page] = next; }
+
+    static mword get_link(mword page)
+    {
+        auto const it{links.find(page)};
+
+        REQUIRE(it != links.end());
+        return it->second;
+    }
+
+    static void free_page(mword page)
+    {
+        links.erase(page);
+        freed.push_back(page);
+    }
+};
+
+using Fake_tlb_cleanup = Generic_tlb_cleanup<Fake_page_link>;
+
+Fake_tlb_cleanup::pointer page(mword addr) { return reinterpret_cast<Fake_tlb_cleanup::pointer>(addr); }
+
+// Follow the links from the given page to the end of the list.
+page_vector follow_links(mword first)
+{
+    page_vector pages;
+
+    for (mword p{first}; p != 0; p = Fake_page_link::get_link(p)) {
+        pages.push_back(p);
+    }
+
+    return pages;
+}
+
+} // anonymous namespace
+
+TEST_CASE("Pages are kept until the TLB flush", "[tlb_cleanup]")
+{
+    Fake_page_link::reset();
+
+    {
+        Fake_tlb_cleanup cleanup;
+
+        CHECK_FALSE(cleanup.need_tlb_flush());
+        CHECK_FALSE(cleanup.has_pages());
+
+        cleanup.free_later(page(0x1000));
+        cleanup.free_later(page(0x2000));
+        cleanup.free_later(page(0x3000));
+
+        CHECK(cleanup.need_tlb_flush());
+        CHECK(cleanup.has_pages());
+        CHECK(Fake_page_link::freed.empty());
+        CHECK(follow_links(0x1000) == page_vector{0x1000, 0x2000, 0x3000});
+
+        cleanup.ignore_tlb_flush();
+        cleanup.free_pages_now();
+
+        CHECK_FALSE(cleanup.has_pages());
+        CHECK(Fake_page_link::freed == page_vector{0x1000, 0x2000, 0x3000});
+    }
+
+    // Nothing is freed twice.
+    CHECK(Fake_page_link::freed.size() == 3);
+    CHECK(Fake_page_link::links.empty());
+}
+
+TEST_CASE("Merging concatenates the page lists", "[tlb_cleanup]")
+{
+    Fake_page_link::reset();
+
+    Fake_tlb_cleanup cleanup;
+    Fake_tlb_cleanup other;
+
+    other.free_later(page(0x3000));
+    other.free_later(page(0x4000));
+
+    SECTION("Into an empty list")
+    {
+        cleanup.merge(other);
+
+        CHECK(follow_links(0x3000) == page_vector{0x3000, 0x4000});
+    }
+
+    SECTION("Into a non-empty list")
+    {
+        cleanup.free_later(page(0x1000));
+        cleanup.free_later(page(0x2000));
+        cleanup.ignore_tlb_flush();
+
+        cleanup.merge(other);
+
+        CHECK(follow_links(0x1000) == page_vector{0x1000, 0x2000, 0x3000, 0x4000});
+    }
+
+    CHECK(cleanup.need_tlb_flush());
+    CHECK(cleanup.has_pages());
+    CHECK_FALSE(other.need_tlb_flush());
+    CHECK_FALSE(other.has_pages());
+    CHECK(Fake_page_link::freed.empty());
+
+    // The list still ends at the last page of the merged list.
+    cleanup.free_later(page(0x5000));
+
+    CHECK(Fake_page_link::get_link(0x4000) == 0x5000);
+    CHECK(Fake_page_link::get_link(0x5000) == 0);
+
+    cleanup.ignore_tlb_flush();
+    cleanup.free_pages_now();
+
+    CHECK(Fake_page_link::freed.back() == 0x5000);
+    CHECK(Fake_page_link::links.empty());
+}
+
+TEST_CASE("Merging an empty list keeps the pages", "[tlb_cleanup]")
+{
+    Fake_page_link::reset();
+
+    Fake_tlb_cleanup cleanup;
+    Fake_tlb_cleanup other{true};
+
+    cleanup.free_later(page(0x1000));
+    cleanup.ignore_tlb_flush();
+
+    cleanup.merge(other);
+
+    CHECK(cleanup.need_tlb_flush());
+    CHECK(follow_links(0x1000) == page_vector{0x1000});
+
+    cleanup.ignore_tlb_flush();
+}
+
+TEST_CASE("Destruction frees pages once the flush is done", "[tlb_cleanup]")
+{
+    Fake_page_link::reset();
+
+    {
+        Fake_tlb_cleanup cleanup;
+
+        cleanup.free_later(page(0x1000));
+        cleanup.free_later(page(0x2000));
+
+        // The owner has flushed the TLBs.
+        cleanup.ignore_tlb_flush();
+    }
+
+    CHECK(Fake_page_link::freed == page_vector{0x1000, 0x2000});
+
+    {
+        // A pending flush without pages is fine.
+        Fake_tlb_cleanup cleanup{true};
+    }
+
+    CHECK(Fake_page_link::freed.size() == 2);
+}
+
+TEST_CASE("Moving transfers the pages", "[tlb_cleanup]")
+{
+    Fake_page_link::reset();
+
+    Fake_tlb_cleanup cleanup;
+
+    cleanup.free_later(page(0x1000));
+
+    Fake_tlb_cleanup moved{std::move(cleanup)};
+
+    CHECK_FALSE(cleanup.has_pages());
+    CHECK_FALSE(cleanup.need_tlb_flush());
+    CHECK(moved.has_pages());
+    CHECK(moved.need_tlb_flush());
+
+    Fake_tlb_cleanup assigned;
+
+    assigned = std::move(moved);
+
+    CHECK_FALSE(moved.has_pages());
+    CHECK(follow_links(0x1000) == page_vector{0x1000});
+
+    assigned.ignore_tlb_flush();
+    assigned.free_pages_now();
+
+    CHECK(Fake_page_link::freed == page_vector{0x1000});
+}
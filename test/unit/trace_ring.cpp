@@ -0,0 +1,91 @@
+/*
+ * Trace Ring Tests
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#include <trace_ring.hpp>
+
+#include <memory>
+
+#include <catch2/catch.hpp>
+
+namespace
+{
+
+// A ring with space for three records after the header.
+using Ring = Trace_ring<4 * sizeof(Trace_record)>;
+
+std::unique_ptr<Ring> make_ring()
+{
+    auto ring{std::make_unique<Ring>()};
+
+    ring->init();
+    return ring;
+}
+
+} // anonymous namespace
+
+TEST_CASE("Trace ring header is initialized", "[trace_ring]")
+{
+    auto ring{make_ring()};
+
+    CHECK(ring->initialized());
+    CHECK(ring->header().head == 0);
+    CHECK(ring->header().record_size == sizeof(Trace_record));
+    CHECK(ring->header().num_records == 3);
+
+    // The header is at the start of the ring, where userspace looks for it.
+    CHECK(reinterpret_cast<void const*>(&ring->header()) == static_cast<void const*>(ring.get()));
+    CHECK(sizeof(Ring) == 4 * sizeof(Trace_record));
+}
+
+TEST_CASE("Trace ring stores records", "[trace_ring]")
+{
+    auto ring{make_ring()};
+    int object;
+
+    ring->record(100, 7, &object, 1U, static_cast<uint8>(2));
+
+    CHECK(ring->header().head == 1);
+
+    Trace_record const& r{ring->at(0)};
+
+    CHECK(r.seq == 1);
+    CHECK(r.tsc == 100);
+    CHECK(r.event == 7);
+    CHECK(r.num_args == 3);
+    CHECK(r.args[0] == reinterpret_cast<uint64>(&object));
+    CHECK(r.args[1] == 1);
+    CHECK(r.args[2] == 2);
+    CHECK(r.args[3] == 0);
+}
+
+TEST_CASE("Trace ring overwrites the oldest records", "[trace_ring]")
+{
+    auto ring{make_ring()};
+
+    for (uint64 i{0}; i < 5; i++) {
+        ring->record(i, 1, i);
+    }
+
+    CHECK(ring->header().head == 5);
+
+    // Records 0 and 1 were overwritten by records 3 and 4.
+    for (uint64 idx{2}; idx < 5; idx++) {
+        Trace_record const& r{ring->at(idx)};
+
+        CHECK(r.seq == idx + 1);
+        CHECK(r.tsc == idx);
+        CHECK(r.args[0] == idx);
+    }
+}
@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+#
+# Decode Hedron binary trace rings.
+#
+# Each input file is a copy of the trace ring of one CPU as mapped by the
+# machine_ctrl_trace hypercall. Files are assigned to CPUs in the order they
+# are given on the command line, unless they are given as CPU=FILE.
+#
+# The output contains the records of all CPUs merged by timestamp.
+#
+# The record layout and event IDs need to match include/trace_ring.hpp and
+# include/trace.hpp.
+
+import argparse
+import struct
+import sys
+
+MAGIC = 0x3130454341525448  # "HTRACE01"
+
+HEADER = struct.Struct("<QQII40x")
+RECORD = struct.Struct("<QQII5Q")
+
+EVENTS = {
+    1: ("SC_ENQUEUE", ["sc", "prio", "left"]),
+    2: ("SC_DEQUEUE", ["sc", "prio", "left"]),
+    3: ("SYSCALL", ["ec", "arg1", "arg2", "arg3"]),
+    4: ("DELEGATE_MEM", ["src", "dst", "sb", "rb", "ord"]),
+    5: ("DELEGATE_PIO", ["src", "dst", "base", "ord"]),
+    6: ("DELEGATE_OBJ", ["src", "dst", "sb", "rb", "ord"]),
+}
+
+
+def decode_ring(cpu, data):
+    magic, head, record_size, num_records = HEADER.unpack_from(data, 0)
+
+    if magic != MAGIC:
+        raise ValueError(f"CPU {cpu}: bad magic {magic:#x}, tracing was never enabled?")
+
+    if record_size != RECORD.size:
+        raise ValueError(f"CPU {cpu}: unsupported record size {record_size}")
+
+    records = []
+
+    # Only the last num_records records are still in the ring.
+    for seq in range(max(head - num_records, 0) + 1, head + 1):
+        offset = record_size * (1 + (seq - 1) % num_records)
+        rec_seq, tsc, event, num_args, *args = RECORD.unpack_from(data, offset)
+
+        # The record was overwritten or is being written.
+        if rec_seq != seq:
+            continue
+
+        records.append((tsc, cpu, event, args[:num_args]))
+
+    return records
+
+
+def format_record(tsc, cpu, event, args):
+    name, arg_names = EVENTS.get(event, (f"EVENT_{event}", []))
+    arg_names = arg_names + [f"arg{i}" for i in range(len(arg_names), len(args))]
+    formatted = " ".join(f"{n}={a:#x}" for n, a in zip(arg_names, args))
+
+    return f"{tsc:>20} [{cpu:2}] {name:<14} {formatted}"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode Hedron binary trace rings.")
+    parser.add_argument("rings", nargs="+", metavar="[CPU=]FILE", help="Trace ring dump")
+    args = parser.parse_args()
+
+    records = []
+
+    for idx, spec in enumerate(args.rings):
+        cpu, sep, path = spec.partition("=")
+        if not sep:
+            cpu, path = idx, spec
+
+        with open(path, "rb") as f:
+            records.extend(decode_ring(int(cpu), f.read()))
+
+    for record in sorted(records):
+        print(format_record(*record))
+
+
+if __name__ == "__main__":
+    try:
+        main()
+    except ValueError as e:
+        print(f"ERROR: {e}", file=sys.stderr)
+        sys.exit(1)